@@ -39,16 +39,19 @@ the use of this software, even if advised of the possibility of such damage.
 
 #include "facedetectcnn.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <string>
 
-#if 0
-#include <opencv2/opencv.hpp>
-cv::TickMeter cvtm;
-#define TIME_START cvtm.reset();cvtm.start();
-#define TIME_END(FUNCNAME) cvtm.stop(); printf(FUNCNAME);printf("=%g\n", cvtm.getTimeMilli());
-#else
-#define TIME_START
-#define TIME_END(FUNCNAME)
+#include <chrono>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 
@@ -57,210 +60,703 @@ cv::TickMeter cvtm;
 extern ConvInfoStruct param_pConvInfo[NUM_CONV_LAYER];
 Filters<float> g_pFilters[NUM_CONV_LAYER];
 
-bool param_initialized = false;
-
 void init_parameters()
 {
     for(int i = 0; i < NUM_CONV_LAYER; i++)
         g_pFilters[i] = param_pConvInfo[i];
 }
 
-vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int width, int height, int step)
+//the blobs of a Filters in the order of ModelFileLayer::blobs
+template<typename Visitor>
+static bool visitFilterBlobs(Filters<float> & filters, Visitor & visitor)
 {
-    CDataBlob<float> dataBlobs[21];
-    CDataBlob<float> conv3priorbox, conv4priorbox, conv5priorbox, conv6priorbox;
-    CDataBlob<float> conv3priorbox_flat, conv4priorbox_flat, conv5priorbox_flat, conv6priorbox_flat, mbox_priorbox;
+    return visitor(filters.weights) && visitor(filters.biases) && visitor(filters.qweights) &&
+           visitor(filters.qscales) && visitor(filters.qpacked);
+}
+
+static size_t alignModelSize(size_t size)
+{
+    return (size + FACEDETECT_MODEL_ALIGN - 1) / FACEDETECT_MODEL_ALIGN * FACEDETECT_MODEL_ALIGN;
+}
 
-    CDataBlob<float> conv3_loc, conv3_conf, conv3_iou;
-    CDataBlob<float> conv3_loc_flat, conv3_conf_flat, conv3_iou_flat;
+//describes the blobs of a layer and assigns their offsets in the file
+struct ModelBlobDescriber
+{
+    ModelFileBlob * pBlob;
+    uint64_t offset;
 
-    CDataBlob<float> conv4_loc, conv4_conf, conv4_iou;
-    CDataBlob<float> conv4_loc_flat, conv4_conf_flat, conv4_iou_flat;
+    template<typename T>
+    bool operator()(const CDataBlob<T> & blob)
+    {
+        memset(pBlob, 0, sizeof(ModelFileBlob));
+        if (!blob.isEmpty())
+        {
+            pBlob->offset = offset;
+            pBlob->rows = blob.rows;
+            pBlob->cols = blob.cols;
+            pBlob->channels = blob.channels;
+            pBlob->channelStep = int32_t(alignModelSize(blob.channels * sizeof(T)));
+            offset += size_t(blob.rows) * blob.cols * pBlob->channelStep;
+        }
+        pBlob++;
+        return true;
+    }
+};
 
-    CDataBlob<float> conv5_loc, conv5_conf, conv5_iou;
-    CDataBlob<float> conv5_loc_flat, conv5_conf_flat, conv5_iou_flat;
+//writes the pixels of the blobs with the channel steps of the file
+struct ModelBlobWriter
+{
+    FILE * file;
 
-    CDataBlob<float> conv6_loc, conv6_conf, conv6_iou;
-    CDataBlob<float> conv6_loc_flat, conv6_conf_flat, conv6_iou_flat;
+    template<typename T>
+    bool operator()(const CDataBlob<T> & blob)
+    {
+        const size_t bytes = blob.channels * sizeof(T);
+        const vector<char> padding(alignModelSize(bytes) - bytes, 0);
+        for (int r = 0; r < blob.rows; r++)
+            for (int c = 0; c < blob.cols; c++)
+                if (fwrite(blob.ptr(r, c), 1, bytes, file) != bytes ||
+                    fwrite(padding.data(), 1, padding.size(), file) != padding.size())
+                    return false;
+        return true;
+    }
+};
 
-    CDataBlob<float> mbox_loc, mbox_conf, mbox_iou;
+//attaches the blobs of a layer to the mapped file after checking them
+struct ModelBlobAttacher
+{
+    unsigned char * pBase;
+    size_t size;
+    const ModelFileBlob * pBlob;
 
-    TIME_START;
-    if (!param_initialized)
+    template<typename T>
+    bool operator()(CDataBlob<T> & blob)
     {
-        init_parameters();
-        param_initialized = true;
+        const ModelFileBlob & desc = *pBlob++;
+        if (desc.offset == 0)
+        {
+            blob.setNULL();
+            return true;
+        }
+        if (desc.rows <= 0 || desc.cols <= 0 || desc.channels <= 0 || desc.offset % FACEDETECT_MODEL_ALIGN != 0 ||
+            desc.channelStep % FACEDETECT_MODEL_ALIGN != 0 || size_t(desc.channelStep) < desc.channels * sizeof(T) ||
+            desc.offset > size || size_t(desc.rows) * desc.cols * desc.channelStep > size - desc.offset)
+            return false;
+
+        blob.attach((T *)(pBase + desc.offset), desc.rows, desc.cols, desc.channels, desc.channelStep);
+        return true;
     }
-    TIME_END("init");
+};
 
- 
-    TIME_START;
-    dataBlobs[0].setDataFrom3x3S2P1to1x1S1P0FromImage(rgbImageData, width, height, 3, step);
-    TIME_END("convert data");
+template<typename T>
+static bool hasShape(const CDataBlob<T> & blob, int rows, int cols, int channels)
+{
+    return blob.rows == rows && blob.cols == cols && blob.channels == channels;
+}
 
-    /***************CONV0*********************/
-    TIME_START;
-    convolution(dataBlobs[0], g_pFilters[0], dataBlobs[1]);
-    TIME_END("conv_head");
+//the filters loaded from a file must have the shapes of the embedded layer, see Filters::operator=()
+static bool hasShape(const Filters<float> & filters, const ConvInfoStruct & info)
+{
+    if (filters.channels != info.channels || filters.num_filters != info.num_filters ||
+        filters.is_depthwise != info.is_depthwise || filters.is_pointwise != info.is_pointwise ||
+        filters.with_relu != info.with_relu || !hasShape(filters.biases, 1, 1, info.num_filters))
+        return false;
+
+    if (info.is_depthwise)
+        return hasShape(filters.weights, 1, 9, info.channels) && filters.qweights.isEmpty() &&
+               filters.qscales.isEmpty() && filters.qpacked.isEmpty();
+
+    const int packedSize = (info.num_filters + 7) / 8 * ((info.channels + 3) / 4) * 32;
+    return hasShape(filters.weights, 1, info.num_filters, info.channels) &&
+           hasShape(filters.qweights, 1, info.num_filters, info.channels) &&
+           hasShape(filters.qscales, 1, 1, info.num_filters) && hasShape(filters.qpacked, 1, 1, packedSize);
+}
 
-    TIME_START;
-    convolutionDP(dataBlobs[1], g_pFilters[1], g_pFilters[2], dataBlobs[2]);
-    TIME_END("conv0");
+struct ModelBlobReleaser
+{
+    template<typename T>
+    bool operator()(CDataBlob<T> & blob)
+    {
+        blob.setNULL();
+        return true;
+    }
+};
 
-    TIME_START;
-    maxpooling2x2S2(dataBlobs[2], dataBlobs[3]);
-    TIME_END("pool0");
+//maps the file and attaches the filters to it, the mapping is kept for the lifetime of the process
+static bool loadModelFile(const char * filename)
+{
+    size_t size = 0;
+    unsigned char * pBase = NULL;
 
-    /***************CONV1*********************/
-    TIME_START;
-    convolution4layerUnit(dataBlobs[3], g_pFilters[3], g_pFilters[4], g_pFilters[5], g_pFilters[6], dataBlobs[4]);
-    TIME_END("conv1");
+#if defined(_WIN32)
+    //no mapping, the file is read into aligned memory
+    FILE * file = fopen(filename, "rb");
+    if (!file)
+    {
+        fprintf(stderr, "%s: Cannot open the model file %s.\n", __FUNCTION__, filename);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    size = size_t(ftell(file));
+    fseek(file, 0, SEEK_SET);
+    pBase = (unsigned char *)myAlloc(size);
+    const bool read = pBase && fread(pBase, 1, size, file) == size;
+    fclose(file);
+    if (!read)
+    {
+        fprintf(stderr, "%s: Cannot read the model file %s.\n", __FUNCTION__, filename);
+        myFree(&pBase);
+        return false;
+    }
+#else
+    const int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        fprintf(stderr, "%s: Cannot open the model file %s.\n", __FUNCTION__, filename);
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    size = size_t(info.st_size);
+    void * pMapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pMapped == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: Cannot map the model file %s.\n", __FUNCTION__, filename);
+        return false;
+    }
+    pBase = (unsigned char *)pMapped;
+#endif
+
+    const ModelFileHeader * pHeader = (const ModelFileHeader *)pBase;
+    const ModelFileLayer * pLayers = (const ModelFileLayer *)(pHeader + 1);
+    bool valid = size >= sizeof(ModelFileHeader) + NUM_CONV_LAYER * sizeof(ModelFileLayer) &&
+                 pHeader->magic == FACEDETECT_MODEL_MAGIC && pHeader->version == FACEDETECT_MODEL_VERSION &&
+                 pHeader->num_layers == NUM_CONV_LAYER && pHeader->align == FACEDETECT_MODEL_ALIGN;
+
+    for (int i = 0; valid && i < NUM_CONV_LAYER; i++)
+    {
+        const ModelFileLayer & layer = pLayers[i];
+        Filters<float> & filters = g_pFilters[i];
+        filters.channels = layer.channels;
+        filters.num_filters = layer.num_filters;
+        filters.is_depthwise = layer.is_depthwise != 0;
+        filters.is_pointwise = layer.is_pointwise != 0;
+        filters.with_relu = layer.with_relu != 0;
+
+        ModelBlobAttacher attacher = { pBase, size, layer.blobs };
+        valid = visitFilterBlobs(filters, attacher) && hasShape(filters, param_pConvInfo[i]);
+    }
+
+    if (valid)
+        return true;
+
+    fprintf(stderr, "%s: %s is not a valid model file of version %d.\n", __FUNCTION__, filename, FACEDETECT_MODEL_VERSION);
+    ModelBlobReleaser releaser;
+    for (int i = 0; i < NUM_CONV_LAYER; i++)
+        visitFilterBlobs(g_pFilters[i], releaser);
+#if defined(_WIN32)
+    myFree(&pBase);
+#else
+    munmap(pBase, size);
+#endif
+    return false;
+}
+
+//guards the one-time initialization of the filters
+static std::mutex g_parameterMutex;
+static bool g_parametersReady = false;
+
+//the filters come from the model file named by FACEDETECT_MODEL if it can be used, otherwise
+//the embedded weights are converted, quantized and packed
+static bool initParameters()
+{
+    std::lock_guard<std::mutex> lock(g_parameterMutex);
+    if (!g_parametersReady)
+    {
+        const char * filename = getenv("FACEDETECT_MODEL");
+        if (!filename || !filename[0] || !loadModelFile(filename))
+            init_parameters();
+        g_parametersReady = true;
+    }
+    return true;
+}
+
+//the filters are initialized once per process, the initialization of the static is thread-safe.
+//afterwards they are only read, all workspaces and threads share them.
+static void init_parameters_once()
+{
+    static const bool initialized = initParameters();
+    (void)initialized;
+}
+
+int facedetect_load_model(const char * filename)
+{
+    if (!filename)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(g_parameterMutex);
+    if (g_parametersReady)
+    {
+        fprintf(stderr, "%s: The model must be loaded before the first detection.\n", __FUNCTION__);
+        return -1;
+    }
+    if (!loadModelFile(filename))
+        return -1;
+
+    g_parametersReady = true;
+    return 0;
+}
+
+int facedetect_save_model(const char * filename)
+{
+    if (!filename)
+        return -1;
+
+    //always the embedded weights, converted like in init_parameters()
+    vector<Filters<float> > filters(NUM_CONV_LAYER);
+    for (int i = 0; i < NUM_CONV_LAYER; i++)
+        filters[i] = param_pConvInfo[i];
+
+    ModelFileHeader header = { FACEDETECT_MODEL_MAGIC, FACEDETECT_MODEL_VERSION, NUM_CONV_LAYER, FACEDETECT_MODEL_ALIGN };
+    vector<ModelFileLayer> layers(NUM_CONV_LAYER);
+    const size_t headerSize = sizeof(header) + layers.size() * sizeof(ModelFileLayer);
+
+    ModelBlobDescriber describer = { NULL, alignModelSize(headerSize) };
+    for (int i = 0; i < NUM_CONV_LAYER; i++)
+    {
+        ModelFileLayer & layer = layers[i];
+        memset(&layer, 0, sizeof(layer));
+        layer.channels = filters[i].channels;
+        layer.num_filters = filters[i].num_filters;
+        layer.is_depthwise = filters[i].is_depthwise;
+        layer.is_pointwise = filters[i].is_pointwise;
+        layer.with_relu = filters[i].with_relu;
+        describer.pBlob = layer.blobs;
+        visitFilterBlobs(filters[i], describer);
+    }
+
+    FILE * file = fopen(filename, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "%s: Cannot create the model file %s.\n", __FUNCTION__, filename);
+        return -1;
+    }
+
+    const vector<char> padding(alignModelSize(headerSize) - headerSize, 0);
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(layers.data(), sizeof(ModelFileLayer), layers.size(), file) == layers.size() &&
+                   fwrite(padding.data(), 1, padding.size(), file) == padding.size();
+
+    ModelBlobWriter writer = { file };
+    for (int i = 0; written && i < NUM_CONV_LAYER; i++)
+        written = visitFilterBlobs(filters[i], writer);
+
+    if (fclose(file) != 0 || !written)
+    {
+        fprintf(stderr, "%s: Cannot write the model file %s.\n", __FUNCTION__, filename);
+        return -1;
+    }
+    return 0;
+}
+
+//measures one step of the network if profiling is enabled for the workspace, the costs are
+//passed to stop() and accumulated in the entry of the step
+class ProfileTimer
+{
+  public:
+    ProfileTimer(FaceDetectWorkspace * workspace, const char * name)
+    {
+        this->workspace = (workspace && workspace->profiling) ? workspace : NULL;
+        this->name = name;
+        if (this->workspace)
+            start = std::chrono::steady_clock::now();
+    }
+
+    bool enabled() const
+    {
+        return workspace != NULL;
+    }
+
+    void stop(double bytesRead = 0, double bytesWritten = 0, double flops = 0)
+    {
+        if (!workspace)
+            return;
+
+        const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        ProfileEntry * entry = NULL;
+        for (size_t i = 0; i < workspace->profile.size() && !entry; i++)
+            if (strcmp(workspace->profile[i].name, name) == 0)
+                entry = &workspace->profile[i];
+
+        if (!entry)
+        {
+            ProfileEntry newEntry = { name, 0, 0.0, 0.0, 0.0, 0.0 };
+            workspace->profile.push_back(newEntry);
+            entry = &workspace->profile.back();
+        }
+
+        entry->calls++;
+        entry->milliseconds += milliseconds;
+        entry->bytesRead += bytesRead;
+        entry->bytesWritten += bytesWritten;
+        entry->flops += flops;
+        workspace = NULL;
+    }
+
+  private:
+    FaceDetectWorkspace * workspace;
+    const char * name;
+    std::chrono::steady_clock::time_point start;
+};
+
+template<typename T>
+static double blobBytes(const CDataBlob<T> & blob)
+{
+    return double(blob.rows) * blob.cols * blob.channels * sizeof(T);
+}
+
+static double filterBytes(const Filters<float> & filters, int precision)
+{
+    double weights = filters.is_depthwise ? 9.0 * filters.channels : double(filters.channels) * filters.num_filters;
+    double bytes = weights * sizeof(float);
+    if (precision == FACEDETECT_PRECISION_INT8 && filters.is_pointwise && !filters.qpacked.isEmpty())
+        bytes = weights + filters.num_filters * sizeof(float); //INT8 weights and their scales
+    return bytes + filters.num_filters * sizeof(float);
+}
+
+//multiply-adds count as two operations, the bias as one
+static double filterFlops(const Filters<float> & filters)
+{
+    double macs = filters.is_depthwise ? 9.0 * filters.channels : double(filters.channels) * filters.num_filters;
+    return 2 * macs + filters.num_filters;
+}
+
+//a point-wise and a depth-wise layer, computed together row by row, p is the point-wise layer.
+//the input is read as inputData + the x2 upsampled pUpsampled if given.
+template<typename TIn, typename TOut>
+static void profiledDP(FaceDetectWorkspace * workspace, const char * name, CDataBlob<TIn> & inputData, int p,
+                       CDataBlob<TOut> & outputData, bool do_relu, int precision, const CDataBlob<TIn> * pUpsampled = NULL)
+{
+    ProfileTimer timer(workspace, name);
+    convolutionDP(inputData, g_pFilters[p], g_pFilters[p + 1], outputData, do_relu, precision, pUpsampled);
+    if (timer.enabled())
+    {
+        const double count = double(outputData.rows) * outputData.cols;
+        const double upsampledBytes = pUpsampled ? blobBytes(*pUpsampled) : 0;
+        const double addFlops = pUpsampled ? double(inputData.channels) : 0;
+        timer.stop(blobBytes(inputData) + upsampledBytes + filterBytes(g_pFilters[p], precision) +
+                   filterBytes(g_pFilters[p + 1], precision),
+                   blobBytes(outputData),
+                   count * (addFlops + filterFlops(g_pFilters[p]) + filterFlops(g_pFilters[p + 1])));
+    }
+}
+
+//the last point-wise and depth-wise layer of a detection head, written to the flattened outputs
+template<typename T>
+static void profiledHead(FaceDetectWorkspace * workspace, const char * name, CDataBlob<T> & inputData, int p,
+                         const HeadOutputs & head, int precision)
+{
+    ProfileTimer timer(workspace, name);
+    convolutionHead(inputData, g_pFilters[p], g_pFilters[p + 1], head, precision);
+    if (timer.enabled())
+    {
+        const double count = double(inputData.rows) * inputData.cols;
+        timer.stop(blobBytes(inputData) + filterBytes(g_pFilters[p], precision) + filterBytes(g_pFilters[p + 1], precision),
+                   count * head.num_priors * 17 * sizeof(float),
+                   count * (filterFlops(g_pFilters[p]) + filterFlops(g_pFilters[p + 1])));
+    }
+}
+
+//two pairs of layers like convolution4layerUnit(), profiled separately
+template<typename TIn, typename TOut>
+static void profiled4layerUnit(FaceDetectWorkspace * workspace, const char * name1, const char * name2,
+                               CDataBlob<TIn> & inputData, int p, CDataBlob<TOut> & outputData, bool do_relu, int precision)
+{
+    CDataBlob<TIn> tmp;
+    profiledDP(workspace, name1, inputData, p, tmp, true, precision);
+    profiledDP(workspace, name2, tmp, p + 2, outputData, do_relu, precision);
+}
+
+template<typename T>
+static void profiledMaxpooling(FaceDetectWorkspace * workspace, const char * name, CDataBlob<T> & inputData, CDataBlob<T> & outputData)
+{
+    ProfileTimer timer(workspace, name);
+    maxpooling2x2S2(inputData, outputData);
+    timer.stop(blobBytes(inputData), blobBytes(outputData), 3 * double(outputData.rows) * outputData.cols * outputData.channels);
+}
+
+//inputoutputData += upsampled inputData
+template<typename T>
+static void profiledUpsampleAdd(FaceDetectWorkspace * workspace, const char * name, CDataBlob<T> & inputData, CDataBlob<T> & inputoutputData)
+{
+    ProfileTimer timer(workspace, name);
+    upsamplex2withadd(inputData, inputoutputData);
+    timer.stop(blobBytes(inputData) + blobBytes(inputoutputData), blobBytes(inputoutputData),
+               double(inputoutputData.rows) * inputoutputData.cols * inputoutputData.channels);
+}
+
+//a pair of layers of the top-down path on inputData + the x2 upsampled coarse blob. the sum is
+//only formed while the rows are read, except in INT8 mode where the point-wise layer quantizes
+//the whole sum, there it is added to inputData first.
+template<typename T>
+static void profiledUpsampledDP(FaceDetectWorkspace * workspace, const char * addName, const char * name,
+                                CDataBlob<T> & coarse, CDataBlob<T> & inputData, int p, CDataBlob<T> & outputData,
+                                int precision)
+{
+    if (precision == FACEDETECT_PRECISION_INT8)
+    {
+        profiledUpsampleAdd(workspace, addName, coarse, inputData);
+        profiledDP(workspace, name, inputData, p, outputData, true, precision);
+    }
+    else
+        profiledDP(workspace, name, inputData, p, outputData, true, precision, &coarse);
+}
+
+//number of priors, step and prior sizes of the four detection heads, finest first
+typedef struct HeadInfo_
+{
+    int head;
+    int num_priors;
+    int step;
+    float sizes[3];
+} HeadInfo;
+
+static const HeadInfo g_heads[4] = {
+    { FACEDETECT_HEAD_CONV3, 3, 8, { 10, 16, 24 } },
+    { FACEDETECT_HEAD_CONV4, 2, 16, { 32, 48 } },
+    { FACEDETECT_HEAD_CONV5, 2, 32, { 64, 96 } },
+    { FACEDETECT_HEAD_CONV6, 3, 64, { 128, 192, 256 } }
+};
+
+//the feature map sizes of the active heads, the same as those of the backbone outputs they
+//start from, and the index of their first prior in the flattened head outputs
+typedef struct HeadLayout_
+{
+    int rows[4];
+    int cols[4];
+    int offsets[4];
+    int num_priors;
+} HeadLayout;
+
+//features[] are the outputs of conv14, conv18, conv22 and conv26, one per head
+template<typename T>
+static void headLayout(CDataBlob<T> * const * features, int heads, HeadLayout & layout)
+{
+    layout.num_priors = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        layout.rows[i] = features[i]->rows;
+        layout.cols[i] = features[i]->cols;
+        layout.offsets[i] = layout.num_priors;
+        if (heads & g_heads[i].head)
+            layout.num_priors += layout.rows[i] * layout.cols[i] * g_heads[i].num_priors;
+    }
+}
+
+//the flattened head outputs are kept in the workspace, they are only reallocated if their size changes
+static void prepareHeadBlob(CDataBlob<float> & blob, int channels)
+{
+    if (blob.isEmpty() || blob.channels != channels)
+        blob.create(1, 1, channels);
+}
+
+//the box regression scales the priors by about 1.5 at most (exp(0.2 * 2)),
+//a head is skipped if none of its priors can reach the requested face sizes.
+static int activeHeads(int minFaceSize, int maxFaceSize)
+{
+    const float maxScale = 1.5f;
+    int heads = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        const HeadInfo & info = g_heads[i];
+        const float smallest = info.sizes[0];
+        const float largest = info.sizes[info.num_priors - 1];
+
+        if (minFaceSize > 0 && largest * maxScale < minFaceSize)
+            continue;
+        if (maxFaceSize > 0 && smallest / maxScale > maxFaceSize)
+            continue;
+
+        heads |= info.head;
+    }
+    return heads;
+}
+
+//the backbone up to conv26. the float blobs hold the network input, the intermediate
+//activations are kept in blobs, which may be stored as float16. with T = float both arrays
+//may be the same. if the stem has been computed, blobs[4] holds its output and the backbone
+//starts there.
+template<typename T>
+static void objectdetect_backbone(CDataBlob<float> * dataBlobs, CDataBlob<T> * blobs, int precision,
+                                  bool stem, FaceDetectWorkspace * workspace)
+{
+    if (!stem)
+    {
+        /***************CONV0*********************/
+        profiledDP(workspace, "conv1+2", dataBlobs[1], 1, blobs[2], true, precision);
+        profiledMaxpooling(workspace, "pool0", blobs[2], blobs[3]);
+
+        /***************CONV1*********************/
+        profiled4layerUnit(workspace, "conv3+4", "conv5+6", blobs[3], 3, blobs[4], true, precision);
+    }
 
     /***************CONV2*********************/
-    TIME_START;
-    convolution4layerUnit(dataBlobs[4], g_pFilters[7], g_pFilters[8], g_pFilters[9], g_pFilters[10], dataBlobs[5]);
-    TIME_END("conv2");
+    profiled4layerUnit(workspace, "conv7+8", "conv9+10", blobs[4], 7, blobs[5], true, precision);
 
     /***************CONV3*********************/
-    TIME_START;
-    maxpooling2x2S2(dataBlobs[5], dataBlobs[6]);
-    TIME_END("pool3");
-    TIME_START;
-    convolution4layerUnit(dataBlobs[6], g_pFilters[11], g_pFilters[12], g_pFilters[13], g_pFilters[14], dataBlobs[7]);
-    TIME_END("conv3");
+    profiledMaxpooling(workspace, "pool3", blobs[5], blobs[6]);
+    profiled4layerUnit(workspace, "conv11+12", "conv13+14", blobs[6], 11, blobs[7], true, precision);
 
     /***************CONV4*********************/
-    TIME_START;
-    maxpooling2x2S2(dataBlobs[7], dataBlobs[8]);
-    TIME_END("pool4");
-    TIME_START;
-    convolution4layerUnit(dataBlobs[8], g_pFilters[15], g_pFilters[16], g_pFilters[17], g_pFilters[18], dataBlobs[9]);
-    TIME_END("conv4");
+    profiledMaxpooling(workspace, "pool4", blobs[7], blobs[8]);
+    profiled4layerUnit(workspace, "conv15+16", "conv17+18", blobs[8], 15, blobs[9], true, precision);
 
     /***************CONV5*********************/
-    TIME_START;
-    maxpooling2x2S2(dataBlobs[9], dataBlobs[10]);
-    TIME_END("pool5");
-    TIME_START;
-    convolution4layerUnit(dataBlobs[10], g_pFilters[19], g_pFilters[20], g_pFilters[21], g_pFilters[22], dataBlobs[11]);
-    TIME_END("conv5");
+    profiledMaxpooling(workspace, "pool5", blobs[9], blobs[10]);
+    profiled4layerUnit(workspace, "conv19+20", "conv21+22", blobs[10], 19, blobs[11], true, precision);
 
     /***************CONV6*********************/
-    TIME_START;
-    maxpooling2x2S2(dataBlobs[11], dataBlobs[12]);
-    TIME_END("pool6");
-    TIME_START;
-    convolution4layerUnit(dataBlobs[12], g_pFilters[23], g_pFilters[24], g_pFilters[25], g_pFilters[26], dataBlobs[13]);
-    TIME_END("conv6");
+    profiledMaxpooling(workspace, "pool6", blobs[11], blobs[12]);
+    profiled4layerUnit(workspace, "conv23+24", "conv25+26", blobs[12], 23, blobs[13], true, precision);
+}
+
+//the top-down path and the heads. features[] are the outputs of conv14, conv18, conv22 and
+//conv26, the upsampled coarser maps are added to them while they are read, in INT8 mode in place.
+//the heads write to the flattened outputs in the workspace, only the heads in the mask are computed.
+template<typename T>
+static void objectdetect_heads(CDataBlob<T> * const * features, CDataBlob<T> * blobs, int precision, int heads,
+                               HeadLayout & layout, FaceDetectWorkspace * workspace)
+{
+    //the top-down path feeds every finer head, so it is only cut below the finest active head
+    const bool need18 = (heads & (FACEDETECT_HEAD_CONV4 | FACEDETECT_HEAD_CONV3)) != 0;
+    const bool need16 = (heads & FACEDETECT_HEAD_CONV5) || need18;
+
+    headLayout(features, heads, layout);
+    prepareHeadBlob(workspace->headLoc, layout.num_priors * 14);
+    prepareHeadBlob(workspace->headConf, layout.num_priors * 2);
+    prepareHeadBlob(workspace->headIoU, layout.num_priors);
+
+    HeadOutputs outputs[4];
+    for (int i = 0; i < 4; i++)
+    {
+        outputs[i].loc = &workspace->headLoc;
+        outputs[i].conf = &workspace->headConf;
+        outputs[i].iou = &workspace->headIoU;
+        outputs[i].num_priors = g_heads[i].num_priors;
+        outputs[i].offset = layout.offsets[i];
+    }
 
     /***************branch6*********************/
-    TIME_START;
-    convolutionDP(dataBlobs[13], g_pFilters[39], g_pFilters[40], dataBlobs[14]);
-    convolutionDP(dataBlobs[14], g_pFilters[41], g_pFilters[42], dataBlobs[15], false);
-    // convolution4layerUnit(dataBlobs[7], g_pFilters[27], g_pFilters[28], g_pFilters[29], g_pFilters[30], dataBlobs[14], false);
-    TIME_END("branch6");
-
-    /*****************add6*********************/    
-    TIME_START;
-    upsamplex2withadd(dataBlobs[14], dataBlobs[11]);
-    TIME_END("add6");
-
-    /***************branch5*********************/
-    TIME_START;
-    convolutionDP(dataBlobs[11], g_pFilters[35], g_pFilters[36], dataBlobs[16]);
-    convolutionDP(dataBlobs[16], g_pFilters[37], g_pFilters[38], dataBlobs[17], false);
-    TIME_END("branch5");
-
-    /*****************add5*********************/
-    TIME_START;
-    upsamplex2withadd(dataBlobs[16], dataBlobs[9]);
-    TIME_END("add5");
-
-    /***************branch4*********************/
-    TIME_START;
-    convolutionDP(dataBlobs[9], g_pFilters[31], g_pFilters[32], dataBlobs[18]);
-    convolutionDP(dataBlobs[18], g_pFilters[33], g_pFilters[34], dataBlobs[19], false);
-    TIME_END("branch4");
-
-    /*****************add4*********************/
-    TIME_START;
-    upsamplex2withadd(dataBlobs[18], dataBlobs[7]);
-    TIME_END("add4");
-
-    /***************branch3*********************/
-    TIME_START;
-    convolution4layerUnit(dataBlobs[7], g_pFilters[27], g_pFilters[28], g_pFilters[29], g_pFilters[30], dataBlobs[20], false);
-    TIME_END("branch3");
-
-    
-    /***************PRIORBOX*********************/
-    TIME_START;
-    float pSizes3[3] = {10, 16, 24};
-    priorbox(dataBlobs[7].cols, dataBlobs[7].rows, width, height, 8, 3, pSizes3, conv3priorbox);
-    TIME_END("prior3");
-
-    TIME_START;
-    float pSizes4[2] = { 32, 48};
-    priorbox(dataBlobs[9].cols, dataBlobs[9].rows, width, height, 16, 2, pSizes4, conv4priorbox);
-    TIME_END("prior4");
-
-    TIME_START;
-    float pSizes5[2] = { 64, 96 };
-    priorbox(dataBlobs[11].cols, dataBlobs[11].rows, width, height, 32, 2, pSizes5, conv5priorbox);
-    TIME_END("prior5");
-
-    TIME_START;
-    float pSizes6[3] = { 128, 192, 256 };
-    priorbox(dataBlobs[13].cols, dataBlobs[13].rows, width, height, 64, 3, pSizes6, conv6priorbox);
-    TIME_END("prior6");
+    profiledDP(workspace, "conv39+40", *features[3], 39, blobs[14], true, precision);
+    if (heads & FACEDETECT_HEAD_CONV6)
+        profiledHead(workspace, "conv41+42 (head6)", blobs[14], 41, outputs[3], precision);
+
+    if (!need16)
+        return;
+
+    /***************add6 + branch5*********************/
+    profiledUpsampledDP(workspace, "add6", "conv35+36 (+add6)", blobs[14], *features[2], 35, blobs[16], precision);
+    if (heads & FACEDETECT_HEAD_CONV5)
+        profiledHead(workspace, "conv37+38 (head5)", blobs[16], 37, outputs[2], precision);
 
+    if (!need18)
+        return;
+
+    /***************add5 + branch4*********************/
+    profiledUpsampledDP(workspace, "add5", "conv31+32 (+add5)", blobs[16], *features[1], 31, blobs[18], precision);
+    if (heads & FACEDETECT_HEAD_CONV4)
+        profiledHead(workspace, "conv33+34 (head4)", blobs[18], 33, outputs[1], precision);
+
+    if (!(heads & FACEDETECT_HEAD_CONV3))
+        return;
+
+    /***************add4 + branch3*********************/
+    profiledUpsampledDP(workspace, "add4", "conv27+28 (+add4)", blobs[18], *features[0], 27, blobs[20], precision);
+    profiledHead(workspace, "conv29+30 (head3)", blobs[20], 29, outputs[0], precision);
+}
+
+template<typename T>
+static void objectdetect_features(CDataBlob<float> * dataBlobs, CDataBlob<T> * blobs, int precision, int heads,
+                                  bool stem, HeadLayout & layout, FaceDetectWorkspace * workspace)
+{
+    CDataBlob<T> * const features[4] = { &blobs[7], &blobs[9], &blobs[11], &blobs[13] };
+    objectdetect_backbone(dataBlobs, blobs, precision, stem, workspace);
+    objectdetect_heads(features, blobs, precision, heads, layout, workspace);
+}
+
+//the flattened prior boxes of the active heads
+static void createPriorBoxes(int width, int height, int heads, const HeadLayout & layout, CDataBlob<float> & mbox_priorbox)
+{
+    CDataBlob<float> priorboxes[4];
+    CDataBlob<float> priorboxes_flat[4];
+    CDataBlob<float> * inputs[4];
+    int num_inputs = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        const HeadInfo & info = g_heads[i];
+        if (!(heads & info.head))
+            continue;
+
+        float sizes[3];
+        memcpy(sizes, info.sizes, sizeof(sizes));
+        priorbox(layout.cols[i], layout.rows[i], width, height, info.step, info.num_priors, sizes, priorboxes[i]);
+        blob2vector(priorboxes[i], priorboxes_flat[i]);
+        inputs[num_inputs++] = &priorboxes_flat[i];
+    }
+
+    concat(inputs, num_inputs, mbox_priorbox);
+}
+
+//the prior boxes are kept in the workspace until the input size or the active heads change
+static void updatePriorBoxes(int width, int height, int heads, const HeadLayout & layout, FaceDetectWorkspace * workspace)
+{
     /***************PRIORBOX*********************/
-    TIME_START;
-    blob2vector(conv3priorbox, conv3priorbox_flat);
-    extract(dataBlobs[20], conv3_loc, conv3_conf, conv3_iou, 3);
-    blob2vector(conv3_loc, conv3_loc_flat);
-    blob2vector(conv3_conf, conv3_conf_flat);
-    blob2vector(conv3_iou, conv3_iou_flat);
-
-    blob2vector(conv4priorbox, conv4priorbox_flat);
-    extract(dataBlobs[19], conv4_loc, conv4_conf, conv4_iou, 2);
-    blob2vector(conv4_loc, conv4_loc_flat);
-    blob2vector(conv4_conf, conv4_conf_flat);
-    blob2vector(conv4_iou, conv4_iou_flat);
-
-    blob2vector(conv5priorbox, conv5priorbox_flat);
-    extract(dataBlobs[17], conv5_loc, conv5_conf, conv5_iou, 2);
-    blob2vector(conv5_loc, conv5_loc_flat);
-    blob2vector(conv5_conf, conv5_conf_flat);
-    blob2vector(conv5_iou, conv5_iou_flat);
-
-    blob2vector(conv6priorbox, conv6priorbox_flat);
-    extract(dataBlobs[15], conv6_loc, conv6_conf, conv6_iou, 3);
-    blob2vector(conv6_loc, conv6_loc_flat);
-    blob2vector(conv6_conf, conv6_conf_flat);
-    blob2vector(conv6_iou, conv6_iou_flat);
-    TIME_END("prior flat");
-
-
-    TIME_START
-    concat4(conv3priorbox_flat, conv4priorbox_flat, conv5priorbox_flat, conv6priorbox_flat, mbox_priorbox);
-    concat4(conv3_loc_flat, conv4_loc_flat, conv5_loc_flat, conv6_loc_flat, mbox_loc);
-    concat4(conv3_conf_flat, conv4_conf_flat, conv5_conf_flat, conv6_conf_flat, mbox_conf);
-    concat4(conv3_iou_flat, conv4_iou_flat, conv5_iou_flat, conv6_iou_flat, mbox_iou);
-    TIME_END("concat prior")
-
-    TIME_START
+    ProfileTimer priorTimer(workspace, "priors");
+    double priorBytes = 0;
+    if (workspace->priors.isEmpty() || workspace->priorWidth != width || workspace->priorHeight != height ||
+        workspace->priorHeads != heads)
+    {
+        createPriorBoxes(width, height, heads, layout, workspace->priors);
+        workspace->priorWidth = width;
+        workspace->priorHeight = height;
+        workspace->priorHeads = heads;
+        priorBytes = blobBytes(workspace->priors);
+    }
+    priorTimer.stop(0, priorBytes);
+}
+
+//decode the faces from the flattened head outputs in the workspace, sink(face) receives them
+//strongest first
+template<typename Sink>
+static void decodeFaces(int width, int height, FaceDetectWorkspace * workspace, Sink & sink)
+{
+    CDataBlob<float> & mbox_loc = workspace->headLoc;
+    CDataBlob<float> & mbox_conf = workspace->headConf;
+    CDataBlob<float> & mbox_iou = workspace->headIoU;
+    const double locBytes = mbox_loc.channels * sizeof(float);
+    const double confBytes = mbox_conf.channels * sizeof(float);
+    const double iouBytes = mbox_iou.channels * sizeof(float);
+
+    //exp, sum and division of the two classes, clamping of the iou
+    ProfileTimer softmaxTimer(workspace, "softmax");
     softmax1vector2class(mbox_conf);
     clamp1vector(mbox_iou);
-    TIME_END("softmax")
+    softmaxTimer.stop(confBytes + iouBytes, confBytes + iouBytes, 3.0 * mbox_conf.channels + 2.0 * mbox_iou.channels);
+
+    //the size range applies before the top 100 are cut, unwanted faces don't displace others
+    const FaceSizeRange sizeRange = { width, height, workspace->minFaceSize, workspace->maxFaceSize };
 
     CDataBlob<float> facesInfo;
-    TIME_START;
-    detection_output(mbox_priorbox, mbox_loc, mbox_conf, mbox_iou, 0.3f, 0.5f, 1000, 100, facesInfo);
-    TIME_END("detection output")
+    ProfileTimer nmsTimer(workspace, "detection output (nms)");
+    detection_output(workspace->priors, mbox_loc, mbox_conf, mbox_iou, 0.3f, 0.5f, 1000, 100, facesInfo, &sizeRange);
+    nmsTimer.stop(blobBytes(workspace->priors) + locBytes + confBytes + iouBytes, blobBytes(facesInfo));
 
-    TIME_START;
-    std::vector<FaceRect> faces;
+    ProfileTimer outputTimer(workspace, "output");
     for (int i = 0; i < facesInfo.cols; i++)
     {
         float * pFaceData = facesInfo.ptr(0,i);
@@ -288,9 +784,9 @@ vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int width, int h
             r.lm[lmidx * 2 + 1] = int(pFaceData[5 + lmidx * 2 + 1] * height + 0.5f);
         }
 
-        faces.push_back(r);
+        sink(r);
     }
-    TIME_END("copy result");
+    outputTimer.stop(blobBytes(facesInfo), facesInfo.cols * sizeof(FaceRect));
 
 // int ii = 2;
 // cv::Mat m1(dataBlobs[ii].rows, dataBlobs[ii].cols, CV_32FC1);
@@ -310,13 +806,602 @@ vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int width, int h
 // }
 // cv::imshow("x2", m2);
 // cv::waitKey(0);
+}
 
+//the bytes per pixel and the channel order of the FACEDETECT_FORMAT_* constants, 0 for unknown formats
+static int formatChannels(int format)
+{
+    if (format == FACEDETECT_FORMAT_BGR || format == FACEDETECT_FORMAT_RGB)
+        return 3;
+    if (format == FACEDETECT_FORMAT_BGRA || format == FACEDETECT_FORMAT_RGBA)
+        return 4;
+    if (format == FACEDETECT_FORMAT_GRAY)
+        return 1;
+    return 0;
+}
+
+static bool formatRgbOrder(int format)
+{
+    return format == FACEDETECT_FORMAT_RGB || format == FACEDETECT_FORMAT_RGBA;
+}
+
+//run the image through the network layer by layer, sink(face) receives the faces
+template<typename Sink>
+static void objectdetect_image(unsigned char * rgbImageData, int width, int height, int step, int format,
+                               int precision, int heads, FaceDetectWorkspace * workspace, Sink & sink)
+{
+    const int channels = formatChannels(format);
+
+    CDataBlob<float> dataBlobs[21];
+
+    //the first layers run fused row by row in FP32, also in INT8 mode, where quantizing them
+    //layer by layer cost more than it saved. FP16 rounds whole feature maps between the layers.
+    const bool stem = (precision != FACEDETECT_PRECISION_FP16);
+
+    if (stem)
+    {
+        ProfileTimer stemTimer(workspace, "stem conv0-6 (fused)");
+        convolutionStem(rgbImageData, width, height, channels, step, formatRgbOrder(format), g_pFilters, dataBlobs[4]);
+        if (stemTimer.enabled())
+        {
+            const double pixels1 = double((height + 1) / 2) * ((width + 1) / 2);
+            const double pixels2 = double(dataBlobs[4].rows) * dataBlobs[4].cols;
+            double bytes = 0;
+            for (int i = 0; i < 7; i++)
+                bytes += filterBytes(g_pFilters[i], precision);
+            stemTimer.stop(double(width) * height * channels + bytes, blobBytes(dataBlobs[4]),
+                           pixels1 * (filterFlops(g_pFilters[0]) + filterFlops(g_pFilters[1]) + filterFlops(g_pFilters[2])) +
+                           pixels2 * (filterFlops(g_pFilters[3]) + filterFlops(g_pFilters[4]) +
+                                      filterFlops(g_pFilters[5]) + filterFlops(g_pFilters[6])));
+        }
+    }
+    else
+    {
+        ProfileTimer inputTimer(workspace, "input");
+        dataBlobs[0].setDataFrom3x3S2P1to1x1S1P0FromImage(rgbImageData, width, height, channels, step,
+                                                          formatRgbOrder(format));
+        inputTimer.stop(double(width) * height * channels, blobBytes(dataBlobs[0]));
+
+        /***************CONV0*********************/
+        ProfileTimer conv0Timer(workspace, "conv0");
+        convolution(dataBlobs[0], g_pFilters[0], dataBlobs[1]);
+        conv0Timer.stop(blobBytes(dataBlobs[0]) + filterBytes(g_pFilters[0], FACEDETECT_PRECISION_FP32), blobBytes(dataBlobs[1]),
+                        double(dataBlobs[1].rows) * dataBlobs[1].cols * filterFlops(g_pFilters[0]));
+    }
+
+    HeadLayout layout;
+    if (precision == FACEDETECT_PRECISION_FP16)
+    {
+        CDataBlob<float16> halfBlobs[21];
+        objectdetect_features(dataBlobs, halfBlobs, precision, heads, stem, layout, workspace);
+    }
+    else
+        objectdetect_features(dataBlobs, dataBlobs, precision, heads, stem, layout, workspace);
+
+    updatePriorBoxes(width, height, heads, layout, workspace);
+    decodeFaces(width, height, workspace, sink);
+}
+
+//video mode. the backbone is split into stages whose outputs are kept in the workspace. output
+//row k of a stage depends on the input rows scale * k + first to scale * k + last, the same
+//holds for the columns. a stage can be computed for a crop of its input that starts at a
+//multiple of scale, the outputs whose inputs lie within the crop are the same as for the
+//whole input.
+typedef struct VideoStage_
+{
+    const char * name;
+    int filter; //the first point-wise layer of the 4-layer unit, 0 for the stem
+    bool pool;
+    int scale;
+    int first;
+    int last;
+} VideoStage;
+
+static const VideoStage g_videoStages[6] = {
+    { "stem conv0-6 (video)", 0, false, 4, -11, 13 },
+    { "conv7-10 (video)", 7, false, 1, -2, 2 },
+    { "pool3+conv11-14 (video)", 11, true, 2, -4, 5 },
+    { "pool4+conv15-18 (video)", 15, true, 2, -4, 5 },
+    { "pool5+conv19-22 (video)", 19, true, 2, -4, 5 },
+    { "pool6+conv23-26 (video)", 23, true, 2, -4, 5 }
+};
+
+//the frame is compared with the previous one in tiles of this many pixels
+static const int g_videoTile = 32;
+
+//above this many regions a stage is recomputed for their bounding box
+static const int g_maxVideoRects = 64;
+
+//rows [row0, row1) and columns [col0, col1) of the image or of a feature map
+typedef struct VideoRect_
+{
+    int row0;
+    int col0;
+    int row1;
+    int col1;
+} VideoRect;
+
+static int floorDiv(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+static double rectArea(const VideoRect & r)
+{
+    return double(r.row1 - r.row0) * (r.col1 - r.col0);
+}
+
+static VideoRect boundingRect(const VideoRect & a, const VideoRect & b)
+{
+    VideoRect r = { MIN(a.row0, b.row0), MIN(a.col0, b.col0), MAX(a.row1, b.row1), MAX(a.col1, b.col1) };
+    return r;
+}
+
+//regions are merged as long as that does not add area, e.g. the runs of neighboring tile rows
+//or regions that overlap after they have grown through a stage
+static void mergeRects(vector<VideoRect> & rects)
+{
+    bool merged = true;
+    while (merged && rects.size() > 1)
+    {
+        merged = false;
+        for (size_t i = 0; i < rects.size() && !merged; i++)
+        {
+            for (size_t j = i + 1; j < rects.size() && !merged; j++)
+            {
+                const VideoRect r = boundingRect(rects[i], rects[j]);
+                if (rectArea(r) <= rectArea(rects[i]) + rectArea(rects[j]))
+                {
+                    rects[i] = r;
+                    rects.erase(rects.begin() + j);
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    if (int(rects.size()) > g_maxVideoRects)
+    {
+        VideoRect r = rects[0];
+        for (size_t i = 1; i < rects.size(); i++)
+            r = boundingRect(r, rects[i]);
+        rects.assign(1, r);
+    }
+}
+
+//the output rows of a stage that depend on the input rows [begin, end), clamped to [0, size)
+static void stageRange(const VideoStage & stage, int begin, int end, int size, int & outBegin, int & outEnd)
+{
+    outBegin = MAX(0, -floorDiv(stage.last - begin, stage.scale));
+    outEnd = MIN(size, floorDiv(end - 1 - stage.first, stage.scale) + 1);
+}
+
+//copy rows x cols pixels from (srcRow, srcCol) of src to (dstRow, dstCol) of dst, both with the same channels
+static void copyPixels(const CDataBlob<float> & src, int srcRow, int srcCol, int rows, int cols,
+                       CDataBlob<float> & dst, int dstRow, int dstCol)
+{
+    for (int r = 0; r < rows; r++)
+        memcpy(dst.ptr(dstRow + r, dstCol), src.ptr(srcRow + r, srcCol), size_t(cols) * src.channelStep);
+}
+
+//one of the stages after the stem for the whole input
+static void computeVideoStage(const VideoStage & stage, CDataBlob<float> & inputData, CDataBlob<float> & outputData)
+{
+    const Filters<float> * pF = g_pFilters + stage.filter;
+    if (stage.pool)
+    {
+        CDataBlob<float> pooled;
+        maxpooling2x2S2(inputData, pooled);
+        convolution4layerUnit(pooled, pF[0], pF[1], pF[2], pF[3], outputData, true, FACEDETECT_PRECISION_FP32);
+    }
+    else
+        convolution4layerUnit(inputData, pF[0], pF[1], pF[2], pF[3], outputData, true, FACEDETECT_PRECISION_FP32);
+}
+
+//the tiles of the frame that differ from the previous one, the previous frame is updated
+static void changedTiles(const unsigned char * rgbImageData, int width, int height, int step, int channels,
+                         vector<unsigned char> & frame, vector<VideoRect> & rects)
+{
+    const int tileCols = (width + g_videoTile - 1) / g_videoTile;
+    const size_t frameStep = size_t(width) * channels;
+    vector<bool> changed(tileCols);
+
+    for (int row0 = 0; row0 < height; row0 += g_videoTile)
+    {
+        const int row1 = MIN(row0 + g_videoTile, height);
+
+        std::fill(changed.begin(), changed.end(), false);
+        for (int row = row0; row < row1; row++)
+        {
+            const unsigned char * pIn = rgbImageData + size_t(step) * row;
+            const unsigned char * pFrame = frame.data() + frameStep * row;
+            for (int tile = 0; tile < tileCols; tile++)
+            {
+                if (changed[tile])
+                    continue;
+                const int col0 = tile * g_videoTile;
+                const int cols = MIN(g_videoTile, width - col0);
+                changed[tile] = (memcmp(pIn + col0 * channels, pFrame + col0 * channels, size_t(cols) * channels) != 0);
+            }
+        }
+
+        //one region per run of changed tiles
+        for (int tile = 0; tile < tileCols; tile++)
+        {
+            if (!changed[tile])
+                continue;
+            int end = tile + 1;
+            while (end < tileCols && changed[end])
+                end++;
+
+            VideoRect r = { row0, tile * g_videoTile, row1, MIN(end * g_videoTile, width) };
+            for (int row = r.row0; row < r.row1; row++)
+                memcpy(frame.data() + frameStep * row + r.col0 * channels, rgbImageData + size_t(step) * row + r.col0 * channels,
+                       size_t(r.col1 - r.col0) * channels);
+            rects.push_back(r);
+            tile = end;
+        }
+    }
+
+    mergeRects(rects);
+}
+
+//single FP32 frames in video mode: only the parts of the backbone outputs that depend on
+//changed tiles are recomputed, then the heads and the detection output run on the whole frame
+template<typename Sink>
+static void objectdetect_video(unsigned char * rgbImageData, int width, int height, int step, int format, int heads,
+                               FaceDetectWorkspace * workspace, Sink & sink)
+{
+    CDataBlob<float> * cache = workspace->videoBlobs;
+    const int channels = formatChannels(format);
+    const bool rgbOrder = formatRgbOrder(format);
+    const bool cached = (workspace->videoWidth == width && workspace->videoHeight == height &&
+                         workspace->videoFormat == format);
+
+    //the regions of the input of the current stage that have changed
+    vector<VideoRect> rects;
+
+    ProfileTimer diffTimer(workspace, "video diff");
+    if (cached)
+        changedTiles(rgbImageData, width, height, step, channels, workspace->videoFrame, rects);
+    else
+    {
+        const size_t frameStep = size_t(width) * channels;
+        workspace->videoFrame.resize(frameStep * height);
+        for (int row = 0; row < height; row++)
+            memcpy(&workspace->videoFrame[frameStep * row], rgbImageData + size_t(step) * row, frameStep);
+    }
+    diffTimer.stop((cached ? 2.0 : 1.0) * width * height * channels, 0);
+
+    for (int s = 0; s < 6; s++)
+    {
+        const VideoStage & stage = g_videoStages[s];
+        CDataBlob<float> & outputData = cache[s];
+        ProfileTimer timer(workspace, stage.name);
+
+        const int inRows = (s == 0) ? height : cache[s - 1].rows;
+        const int inCols = (s == 0) ? width : cache[s - 1].cols;
+
+        //the changed outputs and the crop of them and their inputs that is computed
+        vector<VideoRect> changedRects;
+        vector<VideoRect> crops;
+        double cropArea = 0;
+        for (size_t i = 0; cached && i < rects.size(); i++)
+        {
+            VideoRect out;
+            stageRange(stage, rects[i].row0, rects[i].row1, outputData.rows, out.row0, out.row1);
+            stageRange(stage, rects[i].col0, rects[i].col1, outputData.cols, out.col0, out.col1);
+            if (out.row0 >= out.row1 || out.col0 >= out.col1)
+                continue;
+            changedRects.push_back(out);
+        }
+        mergeRects(changedRects);
+        for (size_t i = 0; i < changedRects.size(); i++)
+        {
+            const VideoRect & out = changedRects[i];
+            VideoRect crop;
+            crop.row0 = MAX(0, out.row0 + floorDiv(stage.first, stage.scale));
+            crop.col0 = MAX(0, out.col0 + floorDiv(stage.first, stage.scale));
+            crop.row1 = MIN(outputData.rows, out.row1 - floorDiv(stage.scale - 1 - stage.last, stage.scale));
+            crop.col1 = MIN(outputData.cols, out.col1 - floorDiv(stage.scale - 1 - stage.last, stage.scale));
+            crops.push_back(crop);
+            cropArea += rectArea(crop);
+        }
+
+        if (!cached || cropArea >= double(outputData.rows) * outputData.cols)
+        {
+            //the whole stage, as in the layer by layer path
+            if (s == 0)
+                convolutionStem(rgbImageData, width, height, channels, step, rgbOrder, g_pFilters, outputData);
+            else
+                computeVideoStage(stage, cache[s - 1], outputData);
+
+            VideoRect all = { 0, 0, outputData.rows, outputData.cols };
+            rects.assign(1, all);
+            timer.stop(0, blobBytes(outputData));
+            continue;
+        }
+
+        for (size_t i = 0; i < crops.size(); i++)
+        {
+            const VideoRect & out = changedRects[i];
+            const VideoRect & crop = crops[i];
+
+            //the crop of the input, it ends with the input if the crop ends with the output
+            const int row0 = crop.row0 * stage.scale;
+            const int col0 = crop.col0 * stage.scale;
+            const int row1 = (crop.row1 == outputData.rows) ? inRows : crop.row1 * stage.scale;
+            const int col1 = (crop.col1 == outputData.cols) ? inCols : crop.col1 * stage.scale;
+
+            CDataBlob<float> cropOutput;
+            if (s == 0)
+            {
+                const unsigned char * pCrop = rgbImageData + size_t(step) * row0 + col0 * channels;
+                convolutionStem(pCrop, col1 - col0, row1 - row0, channels, step, rgbOrder, g_pFilters, cropOutput);
+            }
+            else
+            {
+                CDataBlob<float> cropInput(row1 - row0, col1 - col0, cache[s - 1].channels);
+                copyPixels(cache[s - 1], row0, col0, row1 - row0, col1 - col0, cropInput, 0, 0);
+                computeVideoStage(stage, cropInput, cropOutput);
+            }
+
+            copyPixels(cropOutput, out.row0 - crop.row0, out.col0 - crop.col0, out.row1 - out.row0, out.col1 - out.col0,
+                       outputData, out.row0, out.col0);
+        }
+
+        rects.swap(changedRects);
+        double changedArea = 0;
+        for (size_t i = 0; i < rects.size(); i++)
+            changedArea += rectArea(rects[i]);
+        timer.stop(0, changedArea * outputData.channels * sizeof(float));
+    }
+
+    workspace->videoWidth = width;
+    workspace->videoHeight = height;
+    workspace->videoFormat = format;
+
+    //the top-down path only reads the backbone outputs, it runs on the cached ones
+    CDataBlob<float> blobs[21];
+    CDataBlob<float> * const features[4] = { &cache[2], &cache[3], &cache[4], &cache[5] };
+    HeadLayout layout;
+    objectdetect_heads(features, blobs, FACEDETECT_PRECISION_FP32, heads, layout, workspace);
+    updatePriorBoxes(width, height, heads, layout, workspace);
+    decodeFaces(width, height, workspace, sink);
+}
+
+template<typename Sink>
+static void objectdetect(unsigned char * rgbImageData, int width, int height, int step,
+                         int format, int precision, FaceDetectWorkspace * workspace, Sink & sink)
+{
+    static thread_local FaceDetectWorkspace threadWorkspace;
+    if (!workspace)
+        workspace = &threadWorkspace;
+
+    const int heads = activeHeads(workspace->minFaceSize, workspace->maxFaceSize);
+    if (!heads)
+        return;
+
+    init_parameters_once();
+
+    if (workspace->video && precision == FACEDETECT_PRECISION_FP32)
+    {
+        objectdetect_video(rgbImageData, width, height, step, format, heads, workspace, sink);
+        return;
+    }
+
+    objectdetect_image(rgbImageData, width, height, step, format, precision, heads, workspace, sink);
+}
+
+//collects the faces in a vector
+struct FaceVectorSink
+{
+    vector<FaceRect> * faces;
+
+    void operator()(const FaceRect & face)
+    {
+        faces->push_back(face);
+    }
+};
+
+//writes the faces to the result buffer format of facedetect_cnn(), the count must be cleared
+struct ResultBufferSink
+{
+    unsigned char * buffer;
+
+    void operator()(const FaceRect & face)
+    {
+        int * pCount = (int *)buffer;
+        if (pCount[0] >= 256)
+            return;
+
+        short * p = ((short*)(buffer + 4)) + 142 * size_t(pCount[0]);
+        p[0] = (short)(face.score * face.score * 100);
+        p[1] = (short)face.x;
+        p[2] = (short)face.y;
+        p[3] = (short)face.w;
+        p[4] = (short)face.h;
+        //copy landmarks
+        for (int lmidx = 0; lmidx < 10; lmidx++)
+        {
+            p[5 + lmidx] = (short)face.lm[lmidx];
+        }
+
+        pCount[0]++;
+    }
+};
+
+//writes the faces above a confidence directly to the caller's array
+struct FaceDetectionSink
+{
+    FaceDetection * faces;
+    int count;
+    int maxFaces;
+    float minConfidence;
+
+    void operator()(const FaceRect & face)
+    {
+        //compared truncated like the records of facedetect_cnn(), so that the same threshold
+        //keeps the same faces as filtering the result buffer
+        const float confidence = face.score * face.score * 100;
+        if ((short)confidence <= minConfidence || count >= maxFaces)
+            return;
+
+        FaceDetection & detection = faces[count++];
+        detection.confidence = confidence;
+        detection.x = face.x;
+        detection.y = face.y;
+        detection.w = face.w;
+        detection.h = face.h;
+        for (int lmidx = 0; lmidx < 10; lmidx++)
+        {
+            detection.landmarks[lmidx] = face.lm[lmidx];
+        }
+    }
+};
+
+vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int width, int height, int step, int precision,
+                                  FaceDetectWorkspace * workspace)
+{
+    vector<FaceRect> faces;
+    FaceVectorSink sink = { &faces };
+    objectdetect(rgbImageData, width, height, step, FACEDETECT_FORMAT_BGR, precision, workspace, sink);
     return faces;
 }
 
+FaceDetectWorkspace * facedetect_create_workspace()
+{
+    return new FaceDetectWorkspace();
+}
+
+void facedetect_release_workspace(FaceDetectWorkspace * workspace)
+{
+    delete workspace;
+}
+
+void facedetect_set_face_size_range(FaceDetectWorkspace * workspace, int min_size, int max_size)
+{
+    if (!workspace)
+        return;
+
+    workspace->minFaceSize = std::max(min_size, 0);
+    workspace->maxFaceSize = std::max(max_size, 0);
+}
+
+void facedetect_set_video_mode(FaceDetectWorkspace * workspace, int enable)
+{
+    if (!workspace)
+        return;
+
+    workspace->video = (enable != 0);
+    workspace->videoWidth = 0;
+    workspace->videoHeight = 0;
+    workspace->videoFrame.clear();
+    for (int i = 0; i < 6; i++)
+        workspace->videoBlobs[i].setNULL();
+}
+
+void facedetect_set_profiling(FaceDetectWorkspace * workspace, int enable)
+{
+    if (!workspace)
+        return;
+
+    workspace->profiling = (enable != 0);
+    if (workspace->profiling)
+        workspace->profile.clear();
+}
+
+//one line per step and the totals, the costs are per call
+static std::string profileTable(const vector<ProfileEntry> & profile)
+{
+    double total = 0;
+    double totalPerCall = 0;
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+        total += profile[i].milliseconds;
+        totalPerCall += profile[i].milliseconds / MAX(profile[i].calls, 1);
+    }
+
+    std::string text;
+    char line[256];
+
+    snprintf(line, sizeof(line), "%-24s %7s %10s %6s %10s %10s %10s %9s %8s\n", "step", "calls", "ms/call", "%",
+             "KB read", "KB written", "MFLOP", "GFLOP/s", "GB/s");
+    text += line;
+
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+        const ProfileEntry & e = profile[i];
+        const double calls = MAX(e.calls, 1);
+        const double seconds = MAX(e.milliseconds, 1e-9) / 1000;
+
+        snprintf(line, sizeof(line), "%-24s %7d %10.4f %6.2f %10.1f %10.1f %10.3f %9.2f %8.2f\n", e.name, e.calls,
+                 e.milliseconds / calls, total > 0 ? 100 * e.milliseconds / total : 0.0,
+                 e.bytesRead / calls / 1024, e.bytesWritten / calls / 1024, e.flops / calls / 1e6,
+                 e.flops / seconds / 1e9, (e.bytesRead + e.bytesWritten) / seconds / 1e9);
+        text += line;
+    }
+
+    snprintf(line, sizeof(line), "%-24s %7s %10.4f\n", "total", "", totalPerCall);
+    text += line;
+
+    return text;
+}
+
+//the accumulated totals of all calls
+static std::string profileJson(const vector<ProfileEntry> & profile)
+{
+    std::string text = "{\n  \"steps\": [";
+    char line[512];
+
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+        const ProfileEntry & e = profile[i];
+        snprintf(line, sizeof(line), "%s\n    { \"name\": \"%s\", \"calls\": %d, \"milliseconds\": %.6f, "
+                 "\"bytes_read\": %.0f, \"bytes_written\": %.0f, \"flops\": %.0f }",
+                 i > 0 ? "," : "", e.name, e.calls, e.milliseconds, e.bytesRead, e.bytesWritten, e.flops);
+        text += line;
+    }
+
+    text += "\n  ]\n}\n";
+    return text;
+}
+
+int facedetect_profile_report(FaceDetectWorkspace * workspace, int format, char * buffer, int size)
+{
+    if (!workspace || (format != FACEDETECT_PROFILE_TABLE && format != FACEDETECT_PROFILE_JSON))
+        return -1;
+
+    const std::string text = (format == FACEDETECT_PROFILE_JSON) ? profileJson(workspace->profile)
+                                                                   : profileTable(workspace->profile);
+
+    if (buffer && size > 0)
+    {
+        const size_t length = MIN(text.size(), size_t(size - 1));
+        memcpy(buffer, text.data(), length);
+        buffer[length] = 0;
+    }
+
+    return int(text.size());
+}
+
 int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
     unsigned char * rgb_image_data, int width, int height, int step) //input image, it must be RGB (three-channel) image!
 {
+    return facedetect_cnn(result_buffer, rgb_image_data, width, height, step, FACEDETECT_PRECISION_FP32, NULL);
+}
+
+int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
+    unsigned char * rgb_image_data, int width, int height, int step, //input image, it must be RGB (three-channel) image!
+    int precision)
+{
+    return facedetect_cnn(result_buffer, rgb_image_data, width, height, step, precision, NULL);
+}
+
+int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
+    unsigned char * rgb_image_data, int width, int height, int step, //input image, it must be RGB (three-channel) image!
+    int precision, FaceDetectWorkspace * workspace)
+{
 
     if (!result_buffer)
     {
@@ -330,29 +1415,29 @@ int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing
     result_buffer[2] = 0;
     result_buffer[3] = 0;
 
-    vector<FaceRect> faces = objectdetect_cnn(rgb_image_data, width, height, step);
+    ResultBufferSink sink = { result_buffer };
+    objectdetect(rgb_image_data, width, height, step, FACEDETECT_FORMAT_BGR, precision, workspace, sink);
 
-    int num_faces =(int)faces.size();
-    num_faces = MIN(num_faces, 256);
-
-    int * pCount = (int *)result_buffer;
-    pCount[0] = num_faces;
+    return (int *)result_buffer;
+}
 
-    for (int i = 0; i < num_faces; i++)
+int facedetect_cnn_faces(FaceDetection * faces, int max_faces,
+    unsigned char * rgb_image_data, int width, int height, int step, int format,
+    float min_confidence, int precision, FaceDetectWorkspace * workspace)
+{
+    if ((!faces && max_faces > 0) || !rgb_image_data || max_faces < 0)
     {
-        //copy data
-        short * p = ((short*)(result_buffer + 4)) + 142 * size_t(i);
-        p[0] = (short)(faces[i].score * faces[i].score * 100);
-        p[1] = (short)faces[i].x;
-        p[2] = (short)faces[i].y;
-        p[3] = (short)faces[i].w;
-        p[4] = (short)faces[i].h;
-        //copy landmarks
-        for (int lmidx = 0; lmidx < 10; lmidx++)
-        {
-            p[5 + lmidx] = (short)faces[i].lm[lmidx];
-        }
+        fprintf(stderr, "%s: null buffer memory.\n", __FUNCTION__);
+        return -1;
     }
+    if (!formatChannels(format))
+    {
+        fprintf(stderr, "%s: unknown image format %d.\n", __FUNCTION__, format);
+        return -1;
+    }
+
+    FaceDetectionSink sink = { faces, 0, max_faces, min_confidence };
+    objectdetect(rgb_image_data, width, height, step, format, precision, workspace, sink);
 
-    return pCount;
+    return sink.count;
 }
@@ -209,8 +209,415 @@ inline bool vecAdd(const float * p1, float * p2, int num)
     return true;
 }
 
-bool convolution_1x1pointwise( CDataBlob<float> & inputData,  Filters<float> & filters, CDataBlob<float> & outputData)
+inline bool vecRelu(float * p, int num)
 {
+#if defined(_ENABLE_AVX512)
+    __m512 a, bzeros;
+    bzeros = _mm512_setzero_ps(); //zeros
+    for( int i = 0; i < num; i+=16)
+    {
+        a = _mm512_load_ps(p + i);
+        a = _mm512_max_ps(a, bzeros);
+        _mm512_store_ps(p + i, a);
+    }
+#elif defined(_ENABLE_AVX2)
+    __m256 a, bzeros;
+    bzeros = _mm256_setzero_ps(); //zeros
+    for( int i = 0; i < num; i+=8)
+    {
+        a = _mm256_load_ps(p + i);
+        a = _mm256_max_ps(a, bzeros);
+        _mm256_store_ps(p + i, a);
+    }
+#else    
+    for( int i = 0; i < num; i++)
+        p[i] *= (p[i] >0);
+#endif
+
+    return true;
+}
+
+//p1 and p2 must be 256-bit aligned, num in bytes and a multiple of 32 when AVX2 is enabled.
+//p1 must be in [0, _MAX_INT8_ACTIVATION] to avoid the saturation in _mm256_maddubs_epi16()
+inline float toFloat(float v)
+{
+    return v;
+}
+
+inline float toFloat(float16 v)
+{
+    return float16ToFloat(v);
+}
+
+//convert num elements from float16 storage to float
+inline void float16ToFloatVec(const float16 * pIn, float * pOut, int num)
+{
+    int i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= num; i += 8)
+        _mm256_storeu_ps(pOut + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(pIn + i))));
+#endif
+    for (; i < num; i++)
+        pOut[i] = float16ToFloat(pIn[i]);
+}
+
+//convert num elements from float to float16 storage
+inline void floatToFloat16Vec(const float * pIn, float16 * pOut, int num)
+{
+    int i = 0;
+#if defined(__F16C__)
+    for (; i + 8 <= num; i += 8)
+        _mm_storeu_si128((__m128i *)(pOut + i), _mm256_cvtps_ph(_mm256_loadu_ps(pIn + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for (; i < num; i++)
+        pOut[i] = floatToFloat16(pIn[i]);
+}
+
+//float blobs are read and written in place. float16 rows go through a float scratch row
+//with the same layout as a float blob, so the kernels only ever see float data.
+inline const float * loadRow(CDataBlob<float> & blob, int row, CDataBlob<float> & /*scratch*/)
+{
+    return blob.ptr(row, 0);
+}
+
+inline const float * loadRow(CDataBlob<float16> & blob, int row, CDataBlob<float> & scratch)
+{
+    const int num = MIN(blob.channelStep / int(sizeof(float16)), scratch.channelStep / int(sizeof(float)));
+    for (int col = 0; col < blob.cols; col++)
+        float16ToFloatVec(blob.ptr(row, col), scratch.ptr(0, col), num);
+    return scratch.ptr(0, 0);
+}
+
+inline float * rowForStore(CDataBlob<float> & blob, int row, CDataBlob<float> & /*scratch*/)
+{
+    return blob.ptr(row, 0);
+}
+
+inline float * rowForStore(CDataBlob<float16> & /*blob*/, int /*row*/, CDataBlob<float> & scratch)
+{
+    return scratch.ptr(0, 0);
+}
+
+inline void storeRow(CDataBlob<float> & /*blob*/, int /*row*/, CDataBlob<float> & /*scratch*/)
+{
+}
+
+inline void storeRow(CDataBlob<float16> & blob, int row, CDataBlob<float> & scratch)
+{
+    const int num = MIN(blob.channelStep / int(sizeof(float16)), scratch.channelStep / int(sizeof(float)));
+    for (int col = 0; col < blob.cols; col++)
+        floatToFloat16Vec(scratch.ptr(0, col), blob.ptr(row, col), num);
+}
+
+inline int dotProductInt8(const unsigned char * p1, const signed char * p2, int num)
+{
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    __m256i sum_int32_x8 = _mm256_setzero_si256();
+#if !defined(_ENABLE_AVXVNNI)
+    const __m256i ones_int16_x16 = _mm256_set1_epi16(1);
+#endif
+    for (int i = 0; i < num; i += 32)
+    {
+        __m256i a_uint8_x32 = _mm256_load_si256((__m256i const *)(p1 + i));
+        __m256i b_int8_x32 = _mm256_load_si256((__m256i const *)(p2 + i));
+#if defined(_ENABLE_AVXVNNI)
+        sum_int32_x8 = _mm256_dpbusd_avx_epi32(sum_int32_x8, a_uint8_x32, b_int8_x32);
+#else
+        __m256i sum_int16_x16 = _mm256_maddubs_epi16(a_uint8_x32, b_int8_x32);
+        sum_int32_x8 = _mm256_add_epi32(sum_int32_x8, _mm256_madd_epi16(sum_int16_x16, ones_int16_x16));
+#endif
+    }
+    __m128i sum_int32_x4 = _mm_add_epi32(_mm256_castsi256_si128(sum_int32_x8),
+                                         _mm256_extracti128_si256(sum_int32_x8, 1));
+    sum_int32_x4 = _mm_hadd_epi32(sum_int32_x4, sum_int32_x4);
+    sum_int32_x4 = _mm_hadd_epi32(sum_int32_x4, sum_int32_x4);
+    return _mm_cvtsi128_si32(sum_int32_x4);
+#else
+    int sum = 0;
+    for (int i = 0; i < num; i++)
+        sum += int(p1[i]) * int(p2[i]);
+    return sum;
+#endif
+}
+
+float quantizeActivations(CDataBlob<float> & inputData, CDataBlob<unsigned char> & outputData)
+{
+    outputData.create(inputData.rows, inputData.cols, inputData.channels);
+
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    //without padding in either blob they can be processed as flat vectors
+    const bool vectorized = (inputData.channelStep == int(inputData.channels * sizeof(float))) &&
+                            (outputData.channelStep == inputData.channels);
+#else
+    const bool vectorized = false;
+#endif
+    if (!vectorized)
+        outputData.setZero(); //the padding must be zero for the dot products
+
+    const int len = inputData.rows * inputData.cols * inputData.channels;
+
+    float maxVal = 0.f;
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    if (vectorized)
+    {
+        __m256 max_float_x8 = _mm256_setzero_ps();
+        for (int i = 0; i < len; i += 8)
+            max_float_x8 = _mm256_max_ps(max_float_x8, _mm256_load_ps(inputData.data + i));
+        __m128 max_float_x4 = _mm_max_ps(_mm256_castps256_ps128(max_float_x8), _mm256_extractf128_ps(max_float_x8, 1));
+        max_float_x4 = _mm_max_ps(max_float_x4, _mm_movehl_ps(max_float_x4, max_float_x4));
+        max_float_x4 = _mm_max_ss(max_float_x4, _mm_shuffle_ps(max_float_x4, max_float_x4, 1));
+        maxVal = _mm_cvtss_f32(max_float_x4);
+    }
+    else
+#endif
+    {
+        for (int row = 0; row < inputData.rows; row++)
+            for (int col = 0; col < inputData.cols; col++)
+            {
+                const float * pIn = inputData.ptr(row, col);
+                for (int ch = 0; ch < inputData.channels; ch++)
+                    maxVal = MAX(maxVal, pIn[ch]);
+            }
+    }
+
+    if (maxVal <= 0.f)
+    {
+        outputData.setZero();
+        return 1.f;
+    }
+
+    float scale = _MAX_INT8_ACTIVATION / maxVal;
+
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    if (vectorized)
+    {
+        const __m256 scale_float_x8 = _mm256_set1_ps(scale);
+        const __m256i zeros_int32_x8 = _mm256_setzero_si256();
+        const __m256i max_int32_x8 = _mm256_set1_epi32(_MAX_INT8_ACTIVATION);
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        __m256i v[4];
+        for (int i = 0; i < len; i += 32)
+        {
+            for (int k = 0; k < 4; k++)
+            {
+                v[k] = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_load_ps(inputData.data + i + k * 8), scale_float_x8));
+                v[k] = _mm256_min_epi32(_mm256_max_epi32(v[k], zeros_int32_x8), max_int32_x8);
+            }
+            //the packs work on 128-bit lanes, the permutation restores the original order
+            __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+            packed = _mm256_permutevar8x32_epi32(packed, order);
+            _mm256_store_si256((__m256i *)(outputData.data + i), packed);
+        }
+    }
+    else
+#endif
+    {
+        for (int row = 0; row < inputData.rows; row++)
+            for (int col = 0; col < inputData.cols; col++)
+            {
+                const float * pIn = inputData.ptr(row, col);
+                unsigned char * pOut = outputData.ptr(row, col);
+                for (int ch = 0; ch < inputData.channels; ch++)
+                {
+                    float v = rintf(pIn[ch] * scale);
+                    pOut[ch] = (unsigned char)MIN(MAX(v, 0.f), float(_MAX_INT8_ACTIVATION));
+                }
+            }
+    }
+
+    return 1.f / scale;
+}
+
+float quantizeActivations(CDataBlob<float16> & inputData, CDataBlob<unsigned char> & outputData)
+{
+    outputData.create(inputData.rows, inputData.cols, inputData.channels);
+    outputData.setZero();
+
+    float maxVal = 0.f;
+    for (int row = 0; row < inputData.rows; row++)
+        for (int col = 0; col < inputData.cols; col++)
+        {
+            const float16 * pIn = inputData.ptr(row, col);
+            for (int ch = 0; ch < inputData.channels; ch++)
+                maxVal = MAX(maxVal, float16ToFloat(pIn[ch]));
+        }
+
+    if (maxVal <= 0.f)
+        return 1.f;
+
+    float scale = _MAX_INT8_ACTIVATION / maxVal;
+
+    for (int row = 0; row < inputData.rows; row++)
+        for (int col = 0; col < inputData.cols; col++)
+        {
+            const float16 * pIn = inputData.ptr(row, col);
+            unsigned char * pOut = outputData.ptr(row, col);
+            for (int ch = 0; ch < inputData.channels; ch++)
+            {
+                float v = rintf(float16ToFloat(pIn[ch]) * scale);
+                pOut[ch] = (unsigned char)MIN(MAX(v, 0.f), float(_MAX_INT8_ACTIVATION));
+            }
+        }
+
+    return 1.f / scale;
+}
+
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+//multiply-accumulate 4 input channels, broadcast in a, with a tile of 8 filters x 4 channels.
+//the pairs of channels added up before the 32-bit sums are the same as in dotProductInt8().
+inline __m256i dotProductInt8Tile(__m256i sum, __m256i a, __m256i tile)
+{
+#if defined(_ENABLE_AVXVNNI)
+    return _mm256_dpbusd_avx_epi32(sum, a, tile);
+#else
+    const __m256i ones_int16_x16 = _mm256_set1_epi16(1);
+    return _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(a, tile), ones_int16_x16));
+#endif
+}
+
+inline __m256i broadcastInt8x4(const unsigned char * p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return _mm256_set1_epi32(v);
+}
+#endif
+
+//compute one row of a 1x1 point-wise convolution from quantized input, pScales[] holds the
+//dequantization factor (input scale * weight scale) of each filter. with AVX2 the packed
+//weights of 8 output channels are loaded once for four pixels.
+inline void convolution_1x1pointwiseRowInt8(CDataBlob<unsigned char> & inputData, int row, const Filters<float> & filters,
+                                            const float * pScales, float * pOut, int outChannels, int outPixelStep)
+{
+    int col = 0;
+
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    const int quads = (inputData.channels + 3) / 4;
+    const int pixelStep = inputData.channelStep;
+    const int vecChannels = outChannels / 8 * 8;
+
+    for (; col + 4 <= inputData.cols; col += 4)
+    {
+        const unsigned char * pIn = inputData.ptr(row, col);
+
+        for (int ch = 0; ch < vecChannels; ch += 8)
+        {
+            const signed char * pTiles = filters.qpacked.data + size_t(ch / 8) * quads * 32;
+            __m256i s0 = _mm256_setzero_si256();
+            __m256i s1 = _mm256_setzero_si256();
+            __m256i s2 = _mm256_setzero_si256();
+            __m256i s3 = _mm256_setzero_si256();
+            for (int q = 0; q < quads; q++)
+            {
+                __m256i tile = _mm256_load_si256((__m256i const *)(pTiles + q * 32));
+                s0 = dotProductInt8Tile(s0, broadcastInt8x4(pIn + q * 4), tile);
+                s1 = dotProductInt8Tile(s1, broadcastInt8x4(pIn + pixelStep + q * 4), tile);
+                s2 = dotProductInt8Tile(s2, broadcastInt8x4(pIn + 2 * pixelStep + q * 4), tile);
+                s3 = dotProductInt8Tile(s3, broadcastInt8x4(pIn + 3 * pixelStep + q * 4), tile);
+            }
+            const __m256 scale = _mm256_loadu_ps(pScales + ch);
+            const __m256 bias = _mm256_load_ps(filters.biases.data + ch);
+            _mm256_storeu_ps(pOut + ch, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(s0), scale), bias));
+            _mm256_storeu_ps(pOut + outPixelStep + ch, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(s1), scale), bias));
+            _mm256_storeu_ps(pOut + 2 * outPixelStep + ch, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(s2), scale), bias));
+            _mm256_storeu_ps(pOut + 3 * outPixelStep + ch, _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(s3), scale), bias));
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            for (int ch = vecChannels; ch < outChannels; ch++)
+            {
+                int sum = dotProductInt8(pIn + k * pixelStep, filters.qweights.ptr(0, ch), inputData.channelStep);
+                pOut[ch] = sum * pScales[ch] + filters.biases.data[ch];
+            }
+            pOut += outPixelStep;
+        }
+    }
+#endif
+
+    for (; col < inputData.cols; col++)
+    {
+        const unsigned char * pIn = inputData.ptr(row, col);
+        for (int ch = 0; ch < outChannels; ch++)
+        {
+            int sum = dotProductInt8(pIn, filters.qweights.ptr(0, ch), inputData.channelStep);
+            pOut[ch] = sum * pScales[ch] + filters.biases.data[ch];
+        }
+        pOut += outPixelStep;
+    }
+}
+
+#if defined(_ENABLE_AVX2) && !defined(_ENABLE_AVX512)
+//the four horizontal sums of the accumulators, added in the same order as in dotProduct()
+inline __m128 horizontalSum4(__m256 s0, __m256 s1, __m256 s2, __m256 s3)
+{
+    __m256 sum = _mm256_hadd_ps(_mm256_hadd_ps(s0, s1), _mm256_hadd_ps(s2, s3));
+    return _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+}
+#endif
+
+//1x1 point-wise convolution of num pixels, pIns[i] and pOuts[i] point to the channels of pixel i.
+//the pixels may come from different rows. with AVX2 four pixels share each
+//load of the filter weights, the sums are the same as with dotProduct() pixel by pixel.
+inline void convolution_1x1pointwisePixels(const float * const * pIns, float * const * pOuts, int num, int inChannels,
+                                           const Filters<float> & filters, int outChannels, int outPixelStep, bool do_relu)
+{
+    int i = 0;
+#if defined(_ENABLE_AVX2) && !defined(_ENABLE_AVX512)
+    for (; i + 4 <= num; i += 4)
+    {
+        const float * p0 = pIns[i];
+        const float * p1 = pIns[i + 1];
+        const float * p2 = pIns[i + 2];
+        const float * p3 = pIns[i + 3];
+
+        for (int ch = 0; ch < outChannels; ch++)
+        {
+            const float * pF = filters.weights.ptr(0, ch);
+            __m256 s0 = _mm256_setzero_ps();
+            __m256 s1 = _mm256_setzero_ps();
+            __m256 s2 = _mm256_setzero_ps();
+            __m256 s3 = _mm256_setzero_ps();
+            for (int k = 0; k < inChannels; k += 8)
+            {
+                __m256 w = _mm256_load_ps(pF + k);
+                s0 = _mm256_add_ps(s0, _mm256_mul_ps(_mm256_load_ps(p0 + k), w));
+                s1 = _mm256_add_ps(s1, _mm256_mul_ps(_mm256_load_ps(p1 + k), w));
+                s2 = _mm256_add_ps(s2, _mm256_mul_ps(_mm256_load_ps(p2 + k), w));
+                s3 = _mm256_add_ps(s3, _mm256_mul_ps(_mm256_load_ps(p3 + k), w));
+            }
+            float sums[4];
+            _mm_storeu_ps(sums, _mm_add_ps(horizontalSum4(s0, s1, s2, s3), _mm_set1_ps(filters.biases.data[ch])));
+            pOuts[i][ch] = sums[0];
+            pOuts[i + 1][ch] = sums[1];
+            pOuts[i + 2][ch] = sums[2];
+            pOuts[i + 3][ch] = sums[3];
+        }
+        if (do_relu)
+            for (int k = 0; k < 4; k++)
+                vecRelu(pOuts[i + k], outPixelStep);
+    }
+#endif
+    for (; i < num; i++)
+    {
+        float * pOut = pOuts[i];
+        for (int ch = 0; ch < outChannels; ch++)
+        {
+            const float * pF = filters.weights.ptr(0, ch);
+            pOut[ch] = dotProduct(pIns[i], pF, inChannels);
+            pOut[ch] += filters.biases.data[ch];
+        }
+        if (do_relu)
+            vecRelu(pOut, outPixelStep);
+    }
+}
+
+bool convolution_1x1pointwise( CDataBlob<float> & inputData,  const Filters<float> & filters, CDataBlob<float> & outputData, bool do_relu)
+{
+    const int inPixelStep = inputData.channelStep / sizeof(float);
+    const int outPixelStep = outputData.channelStep / sizeof(float);
+    vector<const float *> pIns(outputData.cols);
+    vector<float *> pOuts(outputData.cols);
+
 // #if defined(_OPENMP)
 // #pragma omp parallel for
 // #endif
@@ -218,21 +625,16 @@ bool convolution_1x1pointwise( CDataBlob<float> & inputData,  Filters<float> & f
     {
         for (int col = 0; col < outputData.cols; col++)
         {
-            float * pOut = outputData.ptr(row, col);
-            const float * pIn = inputData.ptr(row, col);
-
-            for (int ch = 0; ch < outputData.channels; ch++)
-            {
-                const float * pF = filters.weights.ptr(0, ch);
-                pOut[ch] = dotProduct(pIn, pF, inputData.channels);
-                pOut[ch] += filters.biases.data[ch];
-            }
+            pIns[col] = inputData.ptr(row, 0) + size_t(col) * inPixelStep;
+            pOuts[col] = outputData.ptr(row, 0) + size_t(col) * outPixelStep;
         }
+        convolution_1x1pointwisePixels(pIns.data(), pOuts.data(), outputData.cols, inputData.channels,
+                                       filters, outputData.channels, outPixelStep, do_relu);
     }
     return true;
 }
 
-bool convolution_3x3depthwise(CDataBlob<float> & inputData,  Filters<float> & filters, CDataBlob<float> & outputData)
+bool convolution_3x3depthwise(CDataBlob<float> & inputData,  const Filters<float> & filters, CDataBlob<float> & outputData)
 {
     //set all elements in outputData to zeros
     outputData.setZero();
@@ -279,34 +681,10 @@ bool relu(CDataBlob<float> & inputoutputData)
     
     int len = inputoutputData.cols * inputoutputData.rows * inputoutputData.channelStep / sizeof(float);
 
-
-#if defined(_ENABLE_AVX512)
-    __m512 a, bzeros;
-    bzeros = _mm512_setzero_ps(); //zeros
-    for( int i = 0; i < len; i+=16)
-    {
-        a = _mm512_load_ps(inputoutputData.data + i);
-        a = _mm512_max_ps(a, bzeros);
-        _mm512_store_ps(inputoutputData.data + i, a);
-    }
-#elif defined(_ENABLE_AVX2)
-    __m256 a, bzeros;
-    bzeros = _mm256_setzero_ps(); //zeros
-    for( int i = 0; i < len; i+=8)
-    {
-        a = _mm256_load_ps(inputoutputData.data + i);
-        a = _mm256_max_ps(a, bzeros);
-        _mm256_store_ps(inputoutputData.data + i, a);
-    }
-#else    
-    for( int i = 0; i < len; i++)
-        inputoutputData.data[i] *= (inputoutputData.data[i] >0);
-#endif
-
-    return true;
+    return vecRelu(inputoutputData.data, len);
 }
 
-bool convolution(CDataBlob<float> & inputData, Filters<float> & filters, CDataBlob<float> & outputData, bool do_relu)
+bool convolution(CDataBlob<float> & inputData, const Filters<float> & filters, CDataBlob<float> & outputData, bool do_relu)
 {
     if( inputData.isEmpty() || filters.weights.isEmpty() || filters.biases.isEmpty())
     {
@@ -322,7 +700,7 @@ bool convolution(CDataBlob<float> & inputData, Filters<float> & filters, CDataBl
     outputData.create(inputData.rows, inputData.cols, filters.num_filters);
 
     if(filters.is_pointwise && !filters.is_depthwise)
-        convolution_1x1pointwise(inputData, filters, outputData);
+        return convolution_1x1pointwise(inputData, filters, outputData, do_relu); //ReLU is applied per pixel
     else if(!filters.is_pointwise && filters.is_depthwise)
         convolution_3x3depthwise(inputData, filters, outputData);
     else
@@ -334,33 +712,391 @@ bool convolution(CDataBlob<float> & inputData, Filters<float> & filters, CDataBl
     if(do_relu)
         return relu(outputData);
 
-    return true;
+    return true;
+}
+
+//one output pixel of a 3x3 depth-wise convolution with bias and the optional ReLU.
+//pRows[] point to the three input rows centered at the output row, NULL if out of the image.
+//pWeights[] point to the nine filter taps.
+//the accumulation order is the same as in convolution_3x3depthwise() + relu(),
+//so the results are identical to the unfused path.
+inline void depthwise3x3Pixel(float * pRows[3], int col, int cols, int pixelStep,
+                              const float * pWeights[9], const float * pBiases, int num_filters,
+                              float * pOut, bool do_relu)
+{
+    int srcx_start = MAX(0, col - 1);
+    int srcx_end = MIN(col + 2, cols);
+
+#if defined(_ENABLE_AVX512)
+    __m512 bzeros = _mm512_setzero_ps();
+    for (int ch = 0; ch < num_filters; ch += 16)
+    {
+        __m512 sum = _mm512_setzero_ps();
+        for (int r = 0; r < 3; r++)
+        {
+            if (!pRows[r])
+                continue;
+            for (int c = srcx_start; c < srcx_end; c++)
+            {
+                __m512 a = _mm512_load_ps(pRows[r] + size_t(c) * pixelStep + ch);
+                __m512 b = _mm512_load_ps(pWeights[r * 3 + c - col + 1] + ch);
+                sum = _mm512_add_ps(sum, _mm512_mul_ps(a, b));
+            }
+        }
+        sum = _mm512_add_ps(_mm512_load_ps(pBiases + ch), sum);
+        if (do_relu)
+            sum = _mm512_max_ps(sum, bzeros);
+        _mm512_store_ps(pOut + ch, sum);
+    }
+#elif defined(_ENABLE_AVX2)
+    __m256 bzeros = _mm256_setzero_ps();
+    for (int ch = 0; ch < num_filters; ch += 8)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (int r = 0; r < 3; r++)
+        {
+            if (!pRows[r])
+                continue;
+            for (int c = srcx_start; c < srcx_end; c++)
+            {
+                __m256 a = _mm256_load_ps(pRows[r] + size_t(c) * pixelStep + ch);
+                __m256 b = _mm256_load_ps(pWeights[r * 3 + c - col + 1] + ch);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(a, b));
+            }
+        }
+        sum = _mm256_add_ps(_mm256_load_ps(pBiases + ch), sum);
+        if (do_relu)
+            sum = _mm256_max_ps(sum, bzeros);
+        _mm256_store_ps(pOut + ch, sum);
+    }
+#else
+    memset(pOut, 0, pixelStep * sizeof(float));
+    for (int r = 0; r < 3; r++)
+    {
+        if (!pRows[r])
+            continue;
+        for (int c = srcx_start; c < srcx_end; c++)
+            vecMulAdd(pRows[r] + size_t(c) * pixelStep, pWeights[r * 3 + c - col + 1], pOut, num_filters);
+    }
+    vecAdd(pBiases, pOut, num_filters);
+    if (do_relu)
+        vecRelu(pOut, pixelStep);
+#endif
+}
+
+//pOut = pIn + the coarse pixel for num channels, the sum is rounded to the storage type of the
+//blobs like addTo() in upsamplex2withadd() does. pOut may be pIn.
+inline void addUpsampledPixel(const float * pIn, const float * pCoarse, float * pOut, int num)
+{
+    int i = 0;
+#if defined(_ENABLE_AVX2)
+    for (; i + 8 <= num; i += 8)
+        _mm256_store_ps(pOut + i, _mm256_add_ps(_mm256_load_ps(pIn + i), _mm256_load_ps(pCoarse + i)));
+#endif
+    for (; i < num; i++)
+        pOut[i] = pIn[i] + pCoarse[i];
+}
+
+inline void addUpsampledPixel(const float * pIn, const float16 * pCoarse, float * pOut, int num)
+{
+    for (int i = 0; i < num; i++)
+        pOut[i] = float16ToFloat(floatToFloat16(pIn[i] + float16ToFloat(pCoarse[i])));
+}
+
+//loadRow() of inputData + the x2 upsampled coarse blob, the row of upsamplex2withadd(coarse, inputData)
+//without changing inputData. the sum is built in the scratch row.
+template<typename T>
+inline const float * loadRowUpsampled(CDataBlob<T> & inputData, const CDataBlob<T> & coarse, int row,
+                                      CDataBlob<float> & scratch)
+{
+    const float * pIn = loadRow(inputData, row, scratch);
+    float * pOut = scratch.ptr(0, 0);
+    const int step = scratch.channelStep / sizeof(float);
+
+    //with an odd size the first coarse pixel covers three fine ones
+    const int r_offset = coarse.rows * 2 == inputData.rows ? 0 : 1;
+    const int c_offset = coarse.cols * 2 == inputData.cols ? 0 : 1;
+    const int coarseRow = (row - r_offset) / 2;
+
+    for (int col = 0; col < inputData.cols; col++)
+        addUpsampledPixel(pIn + size_t(col) * step, coarse.ptr(coarseRow, (col - c_offset) / 2),
+                          pOut + size_t(col) * step, inputData.channels);
+    return pOut;
+}
+
+//copy a row of head outputs to the flattened outputs, each pixel has num_priors x (14 loc, 2 conf, 1 iou) channels
+inline void storeHeadRow(const float * pRow, int pixelStep, int cols, int row, const HeadOutputs & head)
+{
+    const int num_priors = head.num_priors;
+    const size_t first = head.offset + size_t(row) * cols * num_priors;
+    float * pLoc = head.loc->data + first * 14;
+    float * pConf = head.conf->data + first * 2;
+    float * pIoU = head.iou->data + first;
+
+    for (int col = 0; col < cols; col++)
+    {
+        const float * pIn = pRow + size_t(col) * pixelStep;
+        for (int n = 0; n < num_priors; n++)
+        {
+#if defined(_ENABLE_AVX2)
+            //14 values as two overlapping vectors
+            _mm256_storeu_ps(pLoc, _mm256_loadu_ps(pIn + n * 17));
+            _mm256_storeu_ps(pLoc + 6, _mm256_loadu_ps(pIn + n * 17 + 6));
+#else
+            memcpy(pLoc, pIn + n * 17, 14 * sizeof(float));
+#endif
+            pConf[0] = pIn[n * 17 + 14];
+            pConf[1] = pIn[n * 17 + 15];
+            pIoU[0] = pIn[n * 17 + 16];
+            pLoc += 14;
+            pConf += 2;
+            pIoU++;
+        }
+    }
+}
+
+//1x1 point-wise followed by 3x3 depth-wise, fused row by row.
+//the point-wise output is kept in a ring buffer of three rows and is never
+//materialized for the whole feature map, the ReLU is applied before the store.
+//the rows go to pOutputData or, for a detection head, to the flattened outputs of pHead.
+template<typename TIn, typename TOut>
+static bool convolutionDPRows(CDataBlob<TIn> & inputData, const CDataBlob<TIn> * pUpsampled,
+                              const Filters<float> & filtersP, const Filters<float> & filtersD,
+                              CDataBlob<TOut> * pOutputData, const HeadOutputs * pHead, bool do_relu, int precision)
+{
+    if( inputData.isEmpty() || filtersP.weights.isEmpty() || filtersD.weights.isEmpty())
+    {
+        cerr << __FUNCTION__ << ": The input data or filter data is empty" << endl;
+        return false;
+    }
+    if( !filtersP.is_pointwise || filtersP.is_depthwise || filtersD.is_pointwise || !filtersD.is_depthwise)
+    {
+        cerr << __FUNCTION__ << ": Unsupported filter type." << endl;
+        return false;
+    }
+    if( inputData.channels != filtersP.channels || filtersP.num_filters != filtersD.channels)
+    {
+        cerr << __FUNCTION__ << ": The input data dimension cannot meet filters." << endl;
+        return false;
+    }
+
+    const int rows = inputData.rows;
+    const int cols = inputData.cols;
+
+    if (pUpsampled && (pUpsampled->channels != inputData.channels ||
+                       rows / 2 != pUpsampled->rows || cols / 2 != pUpsampled->cols))
+    {
+        cerr << __FUNCTION__ << ": The upsampled data does not match the input data." << endl;
+        return false;
+    }
+    if (pHead && filtersD.num_filters != pHead->num_priors * 17)
+    {
+        cerr << __FUNCTION__ << ": The filters do not match the detection head." << endl;
+        return false;
+    }
+
+    const bool int8 = (precision == FACEDETECT_PRECISION_INT8) && !filtersP.qweights.isEmpty();
+    if (int8 && pUpsampled)
+    {
+        cerr << __FUNCTION__ << ": Upsampled inputs are not supported in INT8 mode." << endl;
+        return false;
+    }
+
+    CDataBlob<float> rowBuffer(3, cols, filtersP.num_filters);
+    if (pOutputData)
+        pOutputData->create(rows, cols, filtersD.num_filters);
+
+    const int bufferStep = rowBuffer.channelStep / sizeof(float);
+
+    //only used if the blobs are stored as float16, for an upsampled input or for a head
+    CDataBlob<float> inputRow(1, cols, inputData.channels);
+    CDataBlob<float> outputRow(1, cols, filtersD.num_filters);
+    inputRow.setZero();
+    const int inputStep = inputRow.channelStep / sizeof(float);
+    const int outputStep = outputRow.channelStep / sizeof(float);
+
+    const float * pWeights[9];
+    for (int i = 0; i < 9; i++)
+        pWeights[i] = filtersD.weights.ptr(0, i);
+
+    CDataBlob<unsigned char> quantizedInput;
+    vector<float> scales;
+    if (int8)
+    {
+        const float inputScale = quantizeActivations(inputData, quantizedInput);
+        scales.resize(filtersP.num_filters);
+        for (int ch = 0; ch < filtersP.num_filters; ch++)
+            scales[ch] = inputScale * filtersP.qscales.data[ch];
+    }
+
+    vector<const float *> pIns(cols);
+    vector<float *> pOuts(cols);
+
+    auto pointwiseRow = [&](int row) {
+        float * pOut = rowBuffer.ptr(row % 3, 0);
+        if (int8)
+        {
+            convolution_1x1pointwiseRowInt8(quantizedInput, row, filtersP, scales.data(), pOut,
+                                            filtersP.num_filters, bufferStep);
+            return;
+        }
+        const float * pIn = pUpsampled ? loadRowUpsampled(inputData, *pUpsampled, row, inputRow)
+                                       : loadRow(inputData, row, inputRow);
+        for (int col = 0; col < cols; col++)
+        {
+            pIns[col] = pIn + size_t(col) * inputStep;
+            pOuts[col] = pOut + size_t(col) * bufferStep;
+        }
+        convolution_1x1pointwisePixels(pIns.data(), pOuts.data(), cols, inputData.channels,
+                                       filtersP, filtersP.num_filters, bufferStep, false);
+    };
+
+    pointwiseRow(0);
+
+    for (int row = 0; row < rows; row++)
+    {
+        if (row + 1 < rows)
+            pointwiseRow(row + 1);
+
+        float * pRows[3];
+        pRows[0] = (row > 0) ? rowBuffer.ptr((row + 2) % 3, 0) : NULL;
+        pRows[1] = rowBuffer.ptr(row % 3, 0);
+        pRows[2] = (row + 1 < rows) ? rowBuffer.ptr((row + 1) % 3, 0) : NULL;
+
+        float * pOut = pOutputData ? rowForStore(*pOutputData, row, outputRow) : outputRow.ptr(0, 0);
+        for (int col = 0; col < cols; col++)
+            depthwise3x3Pixel(pRows, col, cols, bufferStep, pWeights, filtersD.biases.data,
+                              filtersD.num_filters, pOut + size_t(col) * outputStep, do_relu);
+        if (pOutputData)
+            storeRow(*pOutputData, row, outputRow);
+        else
+            storeHeadRow(pOut, outputStep, cols, row, *pHead);
+    }
+
+    return true;
+}
+
+template<typename TIn, typename TOut>
+bool convolutionDP(CDataBlob<TIn> & inputData, 
+                const Filters<float> & filtersP, const Filters<float> & filtersD, 
+                CDataBlob<TOut> & outputData, bool do_relu, int precision, const CDataBlob<TIn> * pUpsampled)
+{
+    return convolutionDPRows(inputData, pUpsampled, filtersP, filtersD, &outputData, (const HeadOutputs *)NULL,
+                             do_relu, precision);
+}
+
+template bool convolutionDP(CDataBlob<float> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, CDataBlob<float> & outputData, bool do_relu, int precision, const CDataBlob<float> * pUpsampled);
+template bool convolutionDP(CDataBlob<float> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, CDataBlob<float16> & outputData, bool do_relu, int precision, const CDataBlob<float> * pUpsampled);
+template bool convolutionDP(CDataBlob<float16> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, CDataBlob<float16> & outputData, bool do_relu, int precision, const CDataBlob<float16> * pUpsampled);
+template bool convolutionDP(CDataBlob<float16> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, CDataBlob<float> & outputData, bool do_relu, int precision, const CDataBlob<float16> * pUpsampled);
+
+template<typename T>
+bool convolutionHead(CDataBlob<T> & inputData, 
+                const Filters<float> & filtersP, const Filters<float> & filtersD, 
+                const HeadOutputs & head, int precision, const CDataBlob<T> * pUpsampled)
+{
+    return convolutionDPRows(inputData, pUpsampled, filtersP, filtersD, (CDataBlob<float> *)NULL, &head, false, precision);
 }
 
-bool convolutionDP(CDataBlob<float> & inputData, 
-                Filters<float> & filtersP, Filters<float> & filtersD, 
-                CDataBlob<float> & outputData, bool do_relu)
+template bool convolutionHead(CDataBlob<float> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, const HeadOutputs & head, int precision, const CDataBlob<float> * pUpsampled);
+template bool convolutionHead(CDataBlob<float16> & inputData, const Filters<float> & filtersP, const Filters<float> & filtersD, const HeadOutputs & head, int precision, const CDataBlob<float16> * pUpsampled);
+
+//the intermediate blob is stored like the input
+template<typename TIn, typename TOut>
+bool convolution4layerUnit(CDataBlob<TIn> & inputData, 
+                const Filters<float> & filtersP1, const Filters<float> & filtersD1, 
+                const Filters<float> & filtersP2, const Filters<float> & filtersD2, 
+                CDataBlob<TOut> & outputData, bool do_relu, int precision)
 {
-    CDataBlob<float> tmp;
-    bool r1 = convolution(inputData, filtersP, tmp, false);
-    bool r2 = convolution(tmp, filtersD, outputData, do_relu);
+    CDataBlob<TIn> tmp;
+    bool r1 = convolutionDP(inputData, filtersP1, filtersD1, tmp, true, precision);
+    bool r2 = convolutionDP(tmp, filtersP2, filtersD2, outputData, do_relu, precision);
     return r1 && r2;
 }
 
-bool convolution4layerUnit(CDataBlob<float> & inputData, 
-                Filters<float> & filtersP1, Filters<float> & filtersD1, 
-                Filters<float> & filtersP2, Filters<float> & filtersD2, 
-                CDataBlob<float> & outputData, bool do_relu)
+template bool convolution4layerUnit(CDataBlob<float> & inputData, const Filters<float> & filtersP1, const Filters<float> & filtersD1, const Filters<float> & filtersP2, const Filters<float> & filtersD2, CDataBlob<float> & outputData, bool do_relu, int precision);
+template bool convolution4layerUnit(CDataBlob<float16> & inputData, const Filters<float> & filtersP1, const Filters<float> & filtersD1, const Filters<float> & filtersP2, const Filters<float> & filtersD2, CDataBlob<float16> & outputData, bool do_relu, int precision);
+template bool convolution4layerUnit(CDataBlob<float16> & inputData, const Filters<float> & filtersP1, const Filters<float> & filtersD1, const Filters<float> & filtersP2, const Filters<float> & filtersD2, CDataBlob<float> & outputData, bool do_relu, int precision);
+
+//max of the elements at the given offsets for one output pixel
+inline void maxpoolingPixel(const float * pIn, const size_t * inputMatOffsetsInElement, int elementCount,
+                            float * pOut, int channels)
 {
-    CDataBlob<float> tmp;
-    bool r1 = convolutionDP(inputData, filtersP1, filtersD1, tmp, true);
-    bool r2 = convolutionDP(tmp, filtersP2, filtersD2, outputData, do_relu);
-    return r1 && r2;
+#if defined(_ENABLE_NEON)
+    for (int ch = 0; ch < channels; ch += 4)
+    {
+        float32x4_t tmp;
+        float32x4_t maxVal = vld1q_f32(pIn + ch + inputMatOffsetsInElement[0]);
+        for (int ec = 1; ec < elementCount; ec++)
+        {
+            tmp = vld1q_f32(pIn + ch + inputMatOffsetsInElement[ec]);
+            maxVal = vmaxq_f32(maxVal, tmp);
+        }
+        vst1q_f32(pOut + ch, maxVal);
+    }
+#elif defined(_ENABLE_AVX512)
+    for (int ch = 0; ch < channels; ch += 16)
+    {
+        __m512 tmp;
+        __m512 maxVal = _mm512_load_ps((__m512 const*)(pIn + ch + inputMatOffsetsInElement[0]));
+        for (int ec = 1; ec < elementCount; ec++)
+        {
+            tmp = _mm512_load_ps((__m512 const*)(pIn + ch + inputMatOffsetsInElement[ec]));
+            maxVal = _mm512_max_ps(maxVal, tmp);
+        }
+        _mm512_store_ps((__m512*)(pOut + ch), maxVal);
+    }
+#elif defined(_ENABLE_AVX2)
+    for (int ch = 0; ch < channels; ch += 8)
+    {
+        __m256 tmp;
+        __m256 maxVal = _mm256_load_ps((float const*)(pIn + ch + inputMatOffsetsInElement[0]));
+        for (int ec = 1; ec < elementCount; ec++)
+        {
+            tmp = _mm256_load_ps((float const*)(pIn + ch + inputMatOffsetsInElement[ec]));
+            maxVal = _mm256_max_ps(maxVal, tmp);
+        }
+        _mm256_store_ps(pOut + ch, maxVal);
+    }
+#else
+    for (int ch = 0; ch < channels; ch++)
+    {
+        float maxVal = pIn[ch + inputMatOffsetsInElement[0]];
+        for (int ec = 1; ec < elementCount; ec++)
+        {
+            maxVal = MAX(maxVal, pIn[ch + inputMatOffsetsInElement[ec]]);
+        }
+        pOut[ch] = maxVal;
+    }
+#endif
 }
 
+//the maximum is one of the inputs, so the float16 results are exact
+inline void maxpoolingPixel(const float16 * pIn, const size_t * inputMatOffsetsInElement, int elementCount,
+                            float16 * pOut, int channels)
+{
+    int ch = 0;
+#if defined(__F16C__)
+    for (; ch + 8 <= channels; ch += 8)
+    {
+        __m256 maxVal = _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(pIn + ch + inputMatOffsetsInElement[0])));
+        for (int ec = 1; ec < elementCount; ec++)
+            maxVal = _mm256_max_ps(maxVal, _mm256_cvtph_ps(_mm_load_si128((const __m128i *)(pIn + ch + inputMatOffsetsInElement[ec]))));
+        _mm_store_si128((__m128i *)(pOut + ch), _mm256_cvtps_ph(maxVal, _MM_FROUND_TO_NEAREST_INT));
+    }
+#endif
+    for (; ch < channels; ch++)
+    {
+        float maxVal = float16ToFloat(pIn[ch + inputMatOffsetsInElement[0]]);
+        for (int ec = 1; ec < elementCount; ec++)
+            maxVal = MAX(maxVal, float16ToFloat(pIn[ch + inputMatOffsetsInElement[ec]]));
+        pOut[ch] = floatToFloat16(maxVal);
+    }
+}
 
 //only 2X2 S2 is supported
-bool maxpooling2x2S2(CDataBlob<float> &inputData, CDataBlob<float> &outputData)
+template<typename T>
+bool maxpooling2x2S2(CDataBlob<T> &inputData, CDataBlob<T> &outputData)
 {
     if (inputData.isEmpty())
     {
@@ -395,62 +1131,287 @@ bool maxpooling2x2S2(CDataBlob<float> &inputData, CDataBlob<float> &outputData)
             {
                 for (int fc = cstart; fc < cend; fc++)
                 {
-                    inputMatOffsetsInElement[elementCount++] = (size_t(fr) * inputData.cols + fc) * inputData.channelStep / sizeof(float);
+                    inputMatOffsetsInElement[elementCount++] = (size_t(fr) * inputData.cols + fc) * inputData.channelStep / sizeof(T);
                 }
             }
 
-            float * pOut = outputData.ptr(row, col);
-            float * pIn = inputData.data;
+            maxpoolingPixel(inputData.data, inputMatOffsetsInElement, elementCount,
+                            outputData.ptr(row, col), outputData.channels);
+        }
+    }
+    return true;
+}
 
-#if defined(_ENABLE_NEON)
-            for (int ch = 0; ch < outputData.channels; ch += 4)
-            {
-                float32x4_t tmp;
-                float32x4_t maxVal = vld1q_f32(pIn + ch + inputMatOffsetsInElement[0]);
-                for (int ec = 1; ec < elementCount; ec++)
-                {
-                    tmp = vld1q_f32(pIn + ch + inputMatOffsetsInElement[ec]);
-                    maxVal = vmaxq_f32(maxVal, tmp);
-                }
-                vst1q_f32(pOut + ch, maxVal);
-            }
-#elif defined(_ENABLE_AVX512)
-            for (int ch = 0; ch < outputData.channels; ch += 16)
-            {
-                __m512 tmp;
-                __m512 maxVal = _mm512_load_ps((__m512 const*)(pIn + ch + inputMatOffsetsInElement[0]));
-                for (int ec = 1; ec < elementCount; ec++)
-                {
-                    tmp = _mm512_load_ps((__m512 const*)(pIn + ch + inputMatOffsetsInElement[ec]));
-                    maxVal = _mm512_max_ps(maxVal, tmp);
-                }
-                _mm512_store_ps((__m512*)(pOut + ch), maxVal);
-            }
-#elif defined(_ENABLE_AVX2)
-            for (int ch = 0; ch < outputData.channels; ch += 8)
-            {
-                __m256 tmp;
-                __m256 maxVal = _mm256_load_ps((float const*)(pIn + ch + inputMatOffsetsInElement[0]));
-                for (int ec = 1; ec < elementCount; ec++)
-                {
-                    tmp = _mm256_load_ps((float const*)(pIn + ch + inputMatOffsetsInElement[ec]));
-                    maxVal = _mm256_max_ps(maxVal, tmp);
-                }
-                _mm256_store_ps(pOut + ch, maxVal);
-            }
-#else
-            for (int ch = 0; ch < outputData.channels; ch++)
-            {
-                float maxVal = pIn[ch + inputMatOffsetsInElement[0]];
-                for (int ec = 1; ec < elementCount; ec++)
-                {
-                    maxVal = MAX(maxVal, pIn[ch + inputMatOffsetsInElement[ec]]);
-                }
-                pOut[ch] = maxVal;
-            }
+template bool maxpooling2x2S2(CDataBlob<float> &inputData, CDataBlob<float> &outputData);
+template bool maxpooling2x2S2(CDataBlob<float16> &inputData, CDataBlob<float16> &outputData);
+
+//a point-wise + depth-wise layer pair of the fused stem, computed row by row like convolutionDP().
+//the point-wise rows are kept in a ring buffer of three rows.
+struct StemLayerPair
+{
+    const Filters<float> * filtersP;
+    const Filters<float> * filtersD;
+    int rows;
+    int cols;
+    int pointwiseRows; //point-wise rows computed so far
+    CDataBlob<float> ring;
+    const float * pWeights[9];
+    vector<const float *> pIns;
+    vector<float *> pOuts;
+
+    void init(const Filters<float> & P, const Filters<float> & D, int rows, int cols)
+    {
+        this->filtersP = &P;
+        this->filtersD = &D;
+        this->rows = rows;
+        this->cols = cols;
+        this->pointwiseRows = 0;
+        this->ring.create(3, cols, P.num_filters);
+        for (int i = 0; i < 9; i++)
+            this->pWeights[i] = D.weights.ptr(0, i);
+        this->pIns.resize(cols);
+        this->pOuts.resize(cols);
+    }
+
+    //the next point-wise row from an input row with the given pixel step
+    void pointwise(const float * pInRow, int inStep, int inChannels)
+    {
+        const int bufferStep = ring.channelStep / sizeof(float);
+        float * pOut = ring.ptr(pointwiseRows % 3, 0);
+        for (int col = 0; col < cols; col++)
+        {
+            pIns[col] = pInRow + size_t(col) * inStep;
+            pOuts[col] = pOut + size_t(col) * bufferStep;
+        }
+        convolution_1x1pointwisePixels(pIns.data(), pOuts.data(), cols, inChannels,
+                                       *filtersP, filtersP->num_filters, bufferStep, false);
+        pointwiseRows++;
+    }
+
+    //the depth-wise output row, the point-wise rows up to row + 1 must have been computed
+    void depthwise(int row, float * pOutRow, int outStep)
+    {
+        const int bufferStep = ring.channelStep / sizeof(float);
+        float * pRows[3];
+        pRows[0] = (row > 0) ? ring.ptr((row + 2) % 3, 0) : NULL;
+        pRows[1] = ring.ptr(row % 3, 0);
+        pRows[2] = (row + 1 < rows) ? ring.ptr((row + 1) % 3, 0) : NULL;
+
+        for (int col = 0; col < cols; col++)
+            depthwise3x3Pixel(pRows, col, cols, bufferStep, pWeights, filtersD->biases.data,
+                              filtersD->num_filters, pOutRow + size_t(col) * outStep, true);
+    }
+};
+
+//the 3x3 patch around image column col from the rows of the patch, NULL above or below the image
+static inline void imagePatchPixel(const unsigned char * const * pRows, int imgWidth, int imgChannels, const int * srcChannel,
+                                   int col, float * pData, int outPixelStep)
+{
+    memset(pData, 0, outPixelStep * sizeof(float));
+    for (int fy = 0; fy < 3; fy++)
+    {
+        if (pRows[fy] == NULL)
+            continue;
+
+        for (int fx = 0; fx < 3; fx++)
+        {
+            int srcx = col + fx - 1;
+            if (srcx < 0 || srcx >= imgWidth) //out of the range of the image
+                continue;
+
+            const unsigned char * pImgData = pRows[fy] + imgChannels * srcx;
+            for (int ch = 0; ch < 3; ch++)
+                pData[ch * 9 + fy * 3 + fx] = pImgData[srcChannel[ch]];
+        }
+    }
+}
+
+void imagePatchRow(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep, bool rgbOrder,
+                   int row, float * pOut, int cols, int outPixelStep)
+{
+    //the byte of blue, green and red within a pixel
+    int srcChannel[3] = { 0, 1, 2 };
+    if (imgChannels == 1)
+        srcChannel[1] = srcChannel[2] = 0;
+    else if (rgbOrder)
+        std::swap(srcChannel[0], srcChannel[2]);
+
+    const unsigned char * pRows[3];
+    for (int fy = 0; fy < 3; fy++)
+    {
+        int srcy = row * 2 + fy - 1;
+        pRows[fy] = (srcy < 0 || srcy >= imgHeight) ? NULL : imgData + size_t(imgWidthStep) * srcy;
+    }
+
+    int c = 0;
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    //the three rows of a patch are loaded with 16 bytes each and shuffled into the 32 channels of
+    //the pixel. the loads must not leave the rows, the first and the last pixels are done one by one.
+    const int lastLoad = (imgWidth * imgChannels - 16) / imgChannels; //the last first pixel of a load
+    if (imgWidth * imgChannels >= 16 && outPixelStep >= 32)
+    {
+        //shuffle masks of the three rows for the channels 0 to 15 and 16 to 31, 0x80 gives zero
+        unsigned char masks[3][32];
+        for (int i = 0; i < 32; i++)
+        {
+            const int ch = i / 9;
+            const int fy = (i % 9) / 3;
+            const int fx = i % 3;
+            for (int r = 0; r < 3; r++)
+                masks[r][i] = (i < 27 && r == fy) ? (unsigned char)(fx * imgChannels + srcChannel[ch]) : 0x80;
+        }
+
+        __m128i maskLo[3], maskHi[3];
+        for (int r = 0; r < 3; r++)
+        {
+            maskLo[r] = _mm_loadu_si128((const __m128i *)masks[r]);
+            maskHi[r] = _mm_loadu_si128((const __m128i *)(masks[r] + 16));
+        }
+
+        if (cols > 0)
+            imagePatchPixel(pRows, imgWidth, imgChannels, srcChannel, 0, pOut, outPixelStep);
+        c = 1;
+
+        for (; c < cols && c * 2 - 1 <= lastLoad; c++)
+        {
+            const size_t offset = size_t(c * 2 - 1) * imgChannels;
+            const __m128i r0 = pRows[0] ? _mm_loadu_si128((const __m128i *)(pRows[0] + offset)) : _mm_setzero_si128();
+            const __m128i r1 = _mm_loadu_si128((const __m128i *)(pRows[1] + offset));
+            const __m128i r2 = pRows[2] ? _mm_loadu_si128((const __m128i *)(pRows[2] + offset)) : _mm_setzero_si128();
+
+            const __m128i lo = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r0, maskLo[0]), _mm_shuffle_epi8(r1, maskLo[1])),
+                                            _mm_shuffle_epi8(r2, maskLo[2]));
+            const __m128i hi = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r0, maskHi[0]), _mm_shuffle_epi8(r1, maskHi[1])),
+                                            _mm_shuffle_epi8(r2, maskHi[2]));
+
+            float * pData = pOut + size_t(c) * outPixelStep;
+            _mm256_store_ps(pData, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(lo)));
+            _mm256_store_ps(pData + 8, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8))));
+            _mm256_store_ps(pData + 16, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(hi)));
+            _mm256_store_ps(pData + 24, _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8))));
+            if (outPixelStep > 32)
+                memset(pData + 32, 0, (outPixelStep - 32) * sizeof(float));
+        }
+    }
 #endif
+    for (; c < cols; c++)
+        imagePatchPixel(pRows, imgWidth, imgChannels, srcChannel, c * 2, pOut + size_t(c) * outPixelStep, outPixelStep);
+}
+
+bool convolutionStem(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep,
+                     bool rgbOrder, const Filters<float> * filters, CDataBlob<float> & outputData)
+{
+    if (imgData == NULL || imgWidth < 1 || imgHeight < 1)
+    {
+        cerr << __FUNCTION__ << ": The input image data is null." << endl;
+        return false;
+    }
+    if (imgChannels != 1 && imgChannels != 3 && imgChannels != 4)
+    {
+        cerr << __FUNCTION__ << ": The input image must be a 1-, 3- or 4-channel image." << endl;
+        return false;
+    }
+    if (filters[0].channels != 32 || filters[1].channels != filters[0].num_filters ||
+        filters[3].channels != filters[2].num_filters || filters[5].channels != filters[4].num_filters)
+    {
+        cerr << __FUNCTION__ << ": The input data dimension cannot meet filters." << endl;
+        return false;
+    }
+
+    //the sizes of the stride 2 convolution and of the pooling, see maxpooling2x2S2()
+    const int rows1 = (imgHeight + 1) / 2;
+    const int cols1 = (imgWidth + 1) / 2;
+    const int rows2 = static_cast<int>(ceil((rows1 - 3.0f) / 2)) + 1;
+    const int cols2 = static_cast<int>(ceil((cols1 - 3.0f) / 2)) + 1;
+
+    if (rows2 < 1 || cols2 < 1)
+    {
+        cerr << __FUNCTION__ << ": The size of the output is not correct. (" << rows2 << ", " << cols2 << ")." << endl;
+        return false;
+    }
+
+    CDataBlob<float> inputRow(1, cols1, 32);
+    CDataBlob<float> conv0Row(1, cols1, filters[0].num_filters);
+    CDataBlob<float> pair1Rows(2, cols1, filters[2].num_filters); //the two rows of a pooling window
+    CDataBlob<float> poolRow(1, cols2, filters[2].num_filters);
+    CDataBlob<float> pair2Row(1, cols2, filters[4].num_filters);
+    outputData.create(rows2, cols2, filters[6].num_filters);
+
+    StemLayerPair pair1, pair2, pair3;
+    pair1.init(filters[1], filters[2], rows1, cols1);
+    pair2.init(filters[3], filters[4], rows2, cols2);
+    pair3.init(filters[5], filters[6], rows2, cols2);
+
+    vector<const float *> pIns(cols1);
+    vector<float *> pOuts(cols1);
+
+    const int inputStep = inputRow.channelStep / sizeof(float);
+    const int conv0Step = conv0Row.channelStep / sizeof(float);
+    const int pair1Step = pair1Rows.channelStep / sizeof(float);
+    const int poolStep = poolRow.channelStep / sizeof(float);
+    const int pair2Step = pair2Row.channelStep / sizeof(float);
+    const int outputStep = outputData.channelStep / sizeof(float);
+
+    //each function computes the next row of its layer from the rows of the layer before
+    auto nextConv0Row = [&](int row) {
+        //one row of the blob of setDataFrom3x3S2P1to1x1S1P0FromImage()
+        imagePatchRow(imgData, imgWidth, imgHeight, imgChannels, imgWidthStep, rgbOrder, row,
+                      inputRow.data, cols1, inputStep);
+        for (int col = 0; col < cols1; col++)
+        {
+            pIns[col] = inputRow.ptr(0, col);
+            pOuts[col] = conv0Row.ptr(0, col);
+        }
+        convolution_1x1pointwisePixels(pIns.data(), pOuts.data(), cols1, inputRow.channels,
+                                       filters[0], filters[0].num_filters, conv0Step, true);
+        pair1.pointwise(conv0Row.data, conv0Step, conv0Row.channels);
+    };
+
+    auto nextPair1Row = [&](int row) {
+        while (pair1.pointwiseRows <= MIN(row + 1, rows1 - 1))
+            nextConv0Row(pair1.pointwiseRows);
+        pair1.depthwise(row, pair1Rows.ptr(row % 2, 0), pair1Step);
+    };
+
+    auto nextPoolRow = [&](int row) {
+        const int rstart = row * 2;
+        const int rend = MIN(rstart + 2, rows1);
+        for (int r = rstart; r < rend; r++)
+            nextPair1Row(r);
+
+        for (int col = 0; col < cols2; col++)
+        {
+            size_t inputMatOffsetsInElement[4];
+            int elementCount = 0;
+
+            int cstart = col * 2;
+            int cend = MIN(cstart + 2, cols1);
+
+            for (int fr = rstart; fr < rend; fr++)
+                for (int fc = cstart; fc < cend; fc++)
+                    inputMatOffsetsInElement[elementCount++] = (size_t(fr % 2) * cols1 + fc) * pair1Step;
+
+            maxpoolingPixel(pair1Rows.data, inputMatOffsetsInElement, elementCount,
+                            poolRow.ptr(0, col), poolRow.channels);
         }
+
+        pair2.pointwise(poolRow.data, poolStep, poolRow.channels);
+    };
+
+    auto nextPair2Row = [&](int row) {
+        while (pair2.pointwiseRows <= MIN(row + 1, rows2 - 1))
+            nextPoolRow(pair2.pointwiseRows);
+        pair2.depthwise(row, pair2Row.data, pair2Step);
+        pair3.pointwise(pair2Row.data, pair2Step, pair2Row.channels);
+    };
+
+    for (int row = 0; row < rows2; row++)
+    {
+        while (pair3.pointwiseRows <= MIN(row + 1, rows2 - 1))
+            nextPair2Row(pair3.pointwiseRows);
+        pair3.depthwise(row, outputData.ptr(row, 0), outputStep);
     }
+
     return true;
 }
 
@@ -506,6 +1467,49 @@ bool concat4(CDataBlob<T> &inputData1, CDataBlob<T> &inputData2, CDataBlob<T> &i
 }
 template bool concat4( CDataBlob<float> &inputData1, CDataBlob<float> &inputData2, CDataBlob<float> &inputData3, CDataBlob<float> &inputData4, CDataBlob<float> &outputData);
 
+template<typename T>
+bool concat(CDataBlob<T> ** inputs, int num_inputs, CDataBlob<T> &outputData)
+{
+    if (num_inputs < 1)
+    {
+        cerr << __FUNCTION__ << ": There is no input." << endl;
+        return false;
+    }
+
+    int outputCH = 0;
+    for (int i = 0; i < num_inputs; i++)
+    {
+        if (inputs[i]->isEmpty())
+        {
+            cerr << __FUNCTION__ << ": The input data is empty." << endl;
+            return false;
+        }
+        if (inputs[i]->cols != inputs[0]->cols || inputs[i]->rows != inputs[0]->rows)
+        {
+            cerr << __FUNCTION__ << ": The inputs must have the same size." << endl;
+            return false;
+        }
+        outputCH += inputs[i]->channels;
+    }
+
+    outputData.create(inputs[0]->rows, inputs[0]->cols, outputCH);
+
+    for (int row = 0; row < outputData.rows; row++)
+    {
+        for (int col = 0; col < outputData.cols; col++)
+        {
+            T * pOut = outputData.ptr(row, col);
+            for (int i = 0; i < num_inputs; i++)
+            {
+                memcpy(pOut, inputs[i]->ptr(row, col), sizeof(T) * inputs[i]->channels);
+                pOut += inputs[i]->channels;
+            }
+        }
+    }
+    return true;
+}
+template bool concat(CDataBlob<float> ** inputs, int num_inputs, CDataBlob<float> &outputData);
+
 template<typename T>
 bool extract(CDataBlob<T> &inputData, CDataBlob<T> &loc, CDataBlob<T> &conf, CDataBlob<T> &iou, int num_priors)
 {
@@ -680,34 +1684,10 @@ bool blob2vector(CDataBlob<T> &inputData, CDataBlob<T> & outputData)
 }
 template bool blob2vector(CDataBlob<float> &inputData, CDataBlob<float> &outputData);
 
-void IntersectBBox(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2,
-                   NormalizedBBox* intersect_bbox) 
-{
-    if (bbox2.xmin > bbox1.xmax || bbox2.xmax < bbox1.xmin ||
-        bbox2.ymin > bbox1.ymax || bbox2.ymax < bbox1.ymin) 
-    {
-        // Return [0, 0, 0, 0] if there is no intersection.
-        intersect_bbox->xmin = 0;
-        intersect_bbox->ymin = 0;
-        intersect_bbox->xmax = 0;
-        intersect_bbox->ymax = 0;
-    }
-    else
-    {
-        intersect_bbox->xmin = (std::max(bbox1.xmin, bbox2.xmin));
-        intersect_bbox->ymin = (std::max(bbox1.ymin, bbox2.ymin));
-        intersect_bbox->xmax = (std::min(bbox1.xmax, bbox2.xmax));
-        intersect_bbox->ymax = (std::min(bbox1.ymax, bbox2.ymax));
-    }
-}
-
 float JaccardOverlap(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2)
 {
-    NormalizedBBox intersect_bbox;
-    IntersectBBox(bbox1, bbox2, &intersect_bbox);
-    float intersect_width, intersect_height;
-    intersect_width = intersect_bbox.xmax - intersect_bbox.xmin;
-    intersect_height = intersect_bbox.ymax - intersect_bbox.ymin;
+    float intersect_width = MIN(bbox1.xmax, bbox2.xmax) - MAX(bbox1.xmin, bbox2.xmin);
+    float intersect_height = MIN(bbox1.ymax, bbox2.ymax) - MAX(bbox1.ymin, bbox2.ymin);
 
     if (intersect_width > 0 && intersect_height > 0) 
     {
@@ -722,11 +1702,189 @@ float JaccardOverlap(const NormalizedBBox& bbox1, const NormalizedBBox& bbox2)
     }
 }
 
-bool SortScoreBBoxPairDescend(const pair<float, NormalizedBBox>& pair1,   const pair<float, NormalizedBBox>& pair2) 
+//collect the priors with sqrt(face score * iou score) > confidence_threshold.
+//pConf holds (background, face) pairs, the face scores are gathered from the odd elements.
+//the candidates are stored as arrays and stay in the order of the priors.
+static void selectCandidates(const float * pConf, const float * pIoU, int num_priors, float confidence_threshold,
+                             vector<int> & indices, vector<float> & scores)
+{
+    indices.clear();
+    scores.clear();
+
+    int i = 0;
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 ones = _mm256_set1_ps(1.f);
+    const __m256 threshold = _mm256_set1_ps(confidence_threshold);
+    float conf[8];
+
+    for (; i + 8 <= num_priors; i += 8)
+    {
+        __m256 a = _mm256_loadu_ps(pConf + i * 2);
+        __m256 b = _mm256_loadu_ps(pConf + i * 2 + 8);
+        //a1 a3 b1 b3 | a5 a7 b5 b7 -> a1 a3 a5 a7 b1 b3 b5 b7
+        __m256 cls_score = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        cls_score = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(cls_score), _MM_SHUFFLE(3, 1, 2, 0)));
+
+        __m256 iou_score = _mm256_max_ps(_mm256_min_ps(_mm256_loadu_ps(pIoU + i), ones), zeros);
+        __m256 score = _mm256_sqrt_ps(_mm256_mul_ps(cls_score, iou_score));
+
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(score, threshold, _CMP_GT_OQ));
+        if (mask == 0)
+            continue;
+
+        _mm256_storeu_ps(conf, score);
+        for (int k = 0; k < 8; k++)
+        {
+            if (mask & (1 << k))
+            {
+                indices.push_back(i + k);
+                scores.push_back(conf[k]);
+            }
+        }
+    }
+#endif
+    for (; i < num_priors; i++)
+    {
+        float cls_score = pConf[i * 2 + 1];
+        float iou_score = pIoU[i];
+        // clamp
+        if (iou_score < 0.f) {
+            iou_score = 0.f;
+        }
+        else if (iou_score > 1.f) {
+            iou_score = 1.f;
+        }
+        float conf = sqrtf(cls_score * iou_score);
+
+        if (conf > confidence_threshold)
+        {
+            indices.push_back(i);
+            scores.push_back(conf);
+        }
+    }
+}
+
+//the prior of one face, as center and size
+static void priorOf(const float * pPriorBox, int face_idx, float & center_x, float & center_y, float & width, float & height)
+{
+    float fBox_x1 = pPriorBox[face_idx * 4];
+    float fBox_y1 = pPriorBox[face_idx * 4 + 1];
+    float fBox_x2 = pPriorBox[face_idx * 4 + 2];
+    float fBox_y2 = pPriorBox[face_idx * 4 + 3];
+
+    width = fBox_x2 - fBox_x1;
+    height = fBox_y2 - fBox_y1;
+    center_x = (fBox_x1 + fBox_x2)/2;
+    center_y = (fBox_y1 + fBox_y2)/2;
+}
+
+static void decodeBBox(const float * pPriorBox, const float * pLoc, int face_idx, NormalizedBBox & bb)
+{
+    const float prior_variance[4] = {0.1f, 0.1f, 0.2f, 0.2f};
+
+    float prior_center_x, prior_center_y, prior_width, prior_height;
+    priorOf(pPriorBox, face_idx, prior_center_x, prior_center_y, prior_width, prior_height);
+
+    float locx1 = pLoc[face_idx * 14];
+    float locy1 = pLoc[face_idx * 14 + 1];
+    float locx2 = pLoc[face_idx * 14 + 2];
+    float locy2 = pLoc[face_idx * 14 + 3];
+
+    float box_centerx = prior_variance[0] * locx1 * prior_width + prior_center_x;
+    float box_centery = prior_variance[1] * locy1 * prior_height + prior_center_y;
+    float box_width = expf(prior_variance[2] * locx2) * prior_width;
+    float box_height = expf(prior_variance[3] * locy2) * prior_height;
+
+    float fBox_x1 = box_centerx - box_width / 2.f;
+    float fBox_y1 = box_centery - box_height /2.f;
+    float fBox_x2 = box_centerx + box_width / 2.f;
+    float fBox_y2 = box_centery + box_height /2.f;
+
+    bb.xmin = MAX(0, fBox_x1);
+    bb.ymin = MAX(0, fBox_y1);
+    bb.xmax = MIN(1.f, fBox_x2);
+    bb.ymax = MIN(1.f, fBox_y2);
+}
+
+//the five landmarks are only needed for the faces kept by the NMS
+static void decodeLandmarks(const float * pPriorBox, const float * pLoc, int face_idx, NormalizedBBox & bb)
 {
-    return pair1.first > pair2.first;
+    const float prior_variance[2] = {0.1f, 0.1f};
+
+    float prior_center_x, prior_center_y, prior_width, prior_height;
+    priorOf(pPriorBox, face_idx, prior_center_x, prior_center_y, prior_width, prior_height);
+
+    for (int i = 0; i < 5; i++)
+    {
+        float lmx = pLoc[face_idx * 14 + 4 + i * 2];
+        float lmy = pLoc[face_idx * 14 + 4 + i * 2 + 1];
+        lmx = prior_variance[0] * lmx * prior_width + prior_center_x;
+        lmy = prior_variance[1] * lmy * prior_height + prior_center_y;
+        bb.lm[i * 2] = lmx;
+        bb.lm[i * 2 + 1] = lmy;
+    }
 }
 
+//kept boxes stored as arrays for the suppression
+struct KeptBBoxes
+{
+    vector<float> xmin, ymin, xmax, ymax, size;
+
+    void push_back(const NormalizedBBox & bb)
+    {
+        xmin.push_back(bb.xmin);
+        ymin.push_back(bb.ymin);
+        xmax.push_back(bb.xmax);
+        ymax.push_back(bb.ymax);
+        size.push_back((bb.xmax - bb.xmin)*(bb.ymax - bb.ymin));
+    }
+};
+
+//true if the overlap of bb with any of the kept boxes exceeds overlap_threshold,
+//the overlaps are the same as the ones from JaccardOverlap()
+static bool overlapsKept(const NormalizedBBox & bb, const KeptBBoxes & kept, float overlap_threshold)
+{
+    const int num = (int)kept.xmin.size();
+    int k = 0;
+#if defined(_ENABLE_AVX2) || defined(_ENABLE_AVX512)
+    const float bsize = (bb.xmax - bb.xmin)*(bb.ymax - bb.ymin);
+    const __m256 zeros = _mm256_setzero_ps();
+    const __m256 threshold = _mm256_set1_ps(overlap_threshold);
+    const __m256 xmin = _mm256_set1_ps(bb.xmin);
+    const __m256 ymin = _mm256_set1_ps(bb.ymin);
+    const __m256 xmax = _mm256_set1_ps(bb.xmax);
+    const __m256 ymax = _mm256_set1_ps(bb.ymax);
+    const __m256 size = _mm256_set1_ps(bsize);
+
+    for (; k + 8 <= num; k += 8)
+    {
+        __m256 intersect_width = _mm256_sub_ps(_mm256_min_ps(xmax, _mm256_loadu_ps(&kept.xmax[k])),
+                                               _mm256_max_ps(xmin, _mm256_loadu_ps(&kept.xmin[k])));
+        __m256 intersect_height = _mm256_sub_ps(_mm256_min_ps(ymax, _mm256_loadu_ps(&kept.ymax[k])),
+                                                _mm256_max_ps(ymin, _mm256_loadu_ps(&kept.ymin[k])));
+        __m256 valid = _mm256_and_ps(_mm256_cmp_ps(intersect_width, zeros, _CMP_GT_OQ),
+                                     _mm256_cmp_ps(intersect_height, zeros, _CMP_GT_OQ));
+        __m256 intersect_size = _mm256_mul_ps(intersect_width, intersect_height);
+        __m256 overlap = _mm256_div_ps(intersect_size,
+                                       _mm256_sub_ps(_mm256_add_ps(size, _mm256_loadu_ps(&kept.size[k])), intersect_size));
+        __m256 suppress = _mm256_and_ps(valid, _mm256_cmp_ps(overlap, threshold, _CMP_NLE_UQ));
+        if (_mm256_movemask_ps(suppress))
+            return true;
+    }
+#endif
+    for (; k < num; k++)
+    {
+        NormalizedBBox bb2;
+        bb2.xmin = kept.xmin[k];
+        bb2.ymin = kept.ymin[k];
+        bb2.xmax = kept.xmax[k];
+        bb2.ymax = kept.ymax[k];
+        if (!(JaccardOverlap(bb, bb2) <= overlap_threshold))
+            return true;
+    }
+    return false;
+}
 
 bool detection_output(CDataBlob<float> & priorbox,
                       CDataBlob<float> & loc,
@@ -736,7 +1894,8 @@ bool detection_output(CDataBlob<float> & priorbox,
                       float confidence_threshold,
                       int top_k,
                       int keep_top_k,
-                      CDataBlob<float> & outputData)
+                      CDataBlob<float> & outputData,
+                      const FaceSizeRange * size_range)
 {
     if (priorbox.isEmpty() || loc.isEmpty() || conf.isEmpty() )//|| iou.isEmpty())
     {
@@ -751,115 +1910,61 @@ bool detection_output(CDataBlob<float> & priorbox,
         return 0;
     }
 
-    float prior_variance[4] = {0.1f, 0.1f, 0.2f, 0.2f};
     float * pPriorBox = priorbox.ptr(0,0);
     float * pLoc = loc.ptr(0,0);
     float * pConf = conf.ptr(0,0);
     float * pIoU = iou.ptr(0,0);
 
-    vector<pair<float, NormalizedBBox> > score_bbox_vec;
-    vector<pair<float, NormalizedBBox> > final_score_bbox_vec;
-
     //get the candidates those are > confidence_threshold
-    for(int i = 0; i < conf.channels; i+=2)
-    {
-        float cls_score = pConf[i + 1];
-        int face_idx = i / 2;
-        float iou_score = pIoU[face_idx];
-        // clamp
-        if (iou_score < 0.f) {
-            iou_score = 0.f;
-        }
-        else if (iou_score > 1.f) {
-            iou_score = 1.f;
-        }
-        float conf = sqrtf(cls_score * iou_score);
+    vector<int> indices;
+    vector<float> scores;
+    selectCandidates(pConf, pIoU, conf.channels / 2, confidence_threshold, indices, scores);
 
-        if(conf > confidence_threshold)
-        {
-            float fBox_x1 = pPriorBox[face_idx * 4];
-            float fBox_y1 = pPriorBox[face_idx * 4 + 1];
-            float fBox_x2 = pPriorBox[face_idx * 4 + 2];
-            float fBox_y2 = pPriorBox[face_idx * 4 + 3];
-
-            float locx1 = pLoc[face_idx * 14];
-            float locy1 = pLoc[face_idx * 14 + 1];
-            float locx2 = pLoc[face_idx * 14 + 2];
-            float locy2 = pLoc[face_idx * 14 + 3];
-
-            float prior_width = fBox_x2 - fBox_x1;
-            float prior_height = fBox_y2 - fBox_y1;
-            float prior_center_x = (fBox_x1 + fBox_x2)/2;
-            float prior_center_y = (fBox_y1 + fBox_y2)/2;
-
-            float box_centerx = prior_variance[0] * locx1 * prior_width + prior_center_x;
-            float box_centery = prior_variance[1] * locy1 * prior_height + prior_center_y;
-            float box_width = expf(prior_variance[2] * locx2) * prior_width;
-            float box_height = expf(prior_variance[3] * locy2) * prior_height;
-
-            fBox_x1 = box_centerx - box_width / 2.f;
-            fBox_y1 = box_centery - box_height /2.f;
-            fBox_x2 = box_centerx + box_width / 2.f;
-            fBox_y2 = box_centery + box_height /2.f;
-
-            fBox_x1 = MAX(0, fBox_x1);
-            fBox_y1 = MAX(0, fBox_y1);
-            fBox_x2 = MIN(1.f, fBox_x2);
-            fBox_y2 = MIN(1.f, fBox_y2);
-
-            NormalizedBBox bb;
-            bb.xmin = fBox_x1;
-            bb.ymin = fBox_y1;
-            bb.xmax = fBox_x2;
-            bb.ymax = fBox_y2;
-            //store the five landmarks
-            for (int i = 0; i < 5; i++)
-            {
-                float lmx = pLoc[face_idx * 14 + 4 + i * 2];
-                float lmy = pLoc[face_idx * 14 + 4 + i * 2 + 1];
-                lmx = prior_variance[0] * lmx * prior_width + prior_center_x;
-                lmy = prior_variance[1] * lmy * prior_height + prior_center_y;
-                bb.lm[i * 2] = lmx;
-                bb.lm[i * 2 + 1] = lmy;
-            }
+    //sort by descending score, ties keep the order of the priors like a stable sort.
+    //only the top_k candidates are selected and sorted.
+    vector<int> order(indices.size());
+    for (size_t i = 0; i < order.size(); i++)
+        order[i] = (int)i;
 
-            score_bbox_vec.push_back(std::make_pair(conf, bb));
+    struct ScoreDescend
+    {
+        const float * pScores;
+        bool operator()(int a, int b) const
+        {
+            return pScores[a] > pScores[b] || (pScores[a] == pScores[b] && a < b);
         }
+    } scoreDescend = { scores.data() };
+
+    if (top_k > -1 && size_t(top_k) < order.size())
+    {
+        std::nth_element(order.begin(), order.begin() + top_k, order.end(), scoreDescend);
+        order.resize(top_k);
     }
+    std::sort(order.begin(), order.end(), scoreDescend);
 
-    //Sort the score pair according to the scores in descending order
-    std::stable_sort(score_bbox_vec.begin(), score_bbox_vec.end(), SortScoreBBoxPairDescend);
+    //Do NMS, the kept boxes are in descending order so keep_top_k ends it early. faces outside
+    //the size range still suppress weaker ones, but don't count towards keep_top_k.
+    vector<pair<float, NormalizedBBox> > final_score_bbox_vec;
+    KeptBBoxes kept;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        if (keep_top_k > -1 && final_score_bbox_vec.size() >= size_t(keep_top_k))
+            break;
 
-    // Keep top_k scores if needed.
-    if (top_k > -1 && size_t(top_k) < score_bbox_vec.size()) {
-        score_bbox_vec.resize(top_k);
-    }
+        int face_idx = indices[order[i]];
+        NormalizedBBox bb;
+        decodeBBox(pPriorBox, pLoc, face_idx, bb);
 
-    //Do NMS
-    final_score_bbox_vec.clear();
-    while (score_bbox_vec.size() != 0) {
-        const NormalizedBBox bb1 = score_bbox_vec.front().second;
-        bool keep = true;
-        for (size_t k = 0; k < final_score_bbox_vec.size(); k++)
-        {
-            if (keep) 
-            {
-                const NormalizedBBox bb2 = final_score_bbox_vec[k].second;
-                float overlap = JaccardOverlap(bb1, bb2);
-                keep = (overlap <= overlap_threshold);
-            }
-            else 
-            {
-                break;
-            }
-        }
-        if (keep) {
-            final_score_bbox_vec.push_back(score_bbox_vec.front());
-        }
-        score_bbox_vec.erase(score_bbox_vec.begin());
-    }
-    if (keep_top_k > -1 && size_t(keep_top_k) < final_score_bbox_vec.size()) {
-        final_score_bbox_vec.resize(keep_top_k);
+        if (overlapsKept(bb, kept, overlap_threshold))
+            continue;
+
+        kept.push_back(bb);
+
+        if (size_range && !size_range->contains(bb.xmin, bb.ymin, bb.xmax, bb.ymax))
+            continue;
+
+        decodeLandmarks(pPriorBox, pLoc, face_idx, bb);
+        final_score_bbox_vec.push_back(std::make_pair(scores[order[i]], bb));
     }
 
     //copy the results to the output blob
@@ -888,8 +1993,19 @@ bool detection_output(CDataBlob<float> & priorbox,
     return true;
 }
 
+inline void addTo(float & inputOutput, float val)
+{
+    inputOutput += val;
+}
+
+inline void addTo(float16 & inputOutput, float val)
+{
+    inputOutput = floatToFloat16(float16ToFloat(inputOutput) + val);
+}
+
 // TODO optimize in AVX512/NEON/AVX2
-bool upsamplex2withadd(CDataBlob<float> &inputData, CDataBlob<float> &inputoutputData){
+template<typename T>
+bool upsamplex2withadd(CDataBlob<T> &inputData, CDataBlob<T> &inputoutputData){
     if (inputData.isEmpty() || inputoutputData.isEmpty())
     {
         cerr << __FUNCTION__ << ": The input data is empty." << endl;
@@ -927,19 +2043,19 @@ bool upsamplex2withadd(CDataBlob<float> &inputData, CDataBlob<float> &inputoutpu
             {
                 for (int fc = cstart; fc < cend; ++fc)
                 {
-                    inputOutputMatOffsetsInElement[elementCount++] = (size_t(fr) * inputoutputData.cols + fc) * inputoutputData.channelStep / sizeof(float);
+                    inputOutputMatOffsetsInElement[elementCount++] = (size_t(fr) * inputoutputData.cols + fc) * inputoutputData.channelStep / sizeof(T);
                 }
             }
 
-            float * pIn = inputData.ptr(row, col);
-            float * pInOut = inputoutputData.data;
+            T * pIn = inputData.ptr(row, col);
+            T * pInOut = inputoutputData.data;
 
             for (int ch = 0; ch < inputData.channels; ++ch)
             {
-                float val = pIn[ch];
+                float val = toFloat(pIn[ch]);
                 for (int ec = 0; ec < elementCount; ++ec)
                 {
-                    pInOut[ch + inputOutputMatOffsetsInElement[ec]] += val;
+                    addTo(pInOut[ch + inputOutputMatOffsetsInElement[ec]], val);
                 }
             }
         }
@@ -947,3 +2063,5 @@ bool upsamplex2withadd(CDataBlob<float> &inputData, CDataBlob<float> &inputoutpu
     return true;
 }
 
+template bool upsamplex2withadd(CDataBlob<float> &inputData, CDataBlob<float> &inputoutputData);
+template bool upsamplex2withadd(CDataBlob<float16> &inputData, CDataBlob<float16> &inputoutputData);
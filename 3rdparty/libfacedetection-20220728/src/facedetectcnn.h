@@ -48,10 +48,104 @@ the use of this software, even if advised of the possibility of such damage.
 FACEDETECTION_EXPORT int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
                     unsigned char * rgb_image_data, int width, int height, int step); //input image, it must be BGR (three channels) insteed of RGB image!
 
+//precision of the point-wise convolutions and of the activations between layers
+#define FACEDETECT_PRECISION_FP32 0
+#define FACEDETECT_PRECISION_INT8 1 //UINT8 activations * INT8 weights, dequantized to float per layer
+#define FACEDETECT_PRECISION_FP16 2 //FP16 activations between layers, FP32 arithmetic
+
+//pixel formats of the input images, the channels in memory order. the network reads them
+//directly, grayscale pixels are used for all three color channels
+#define FACEDETECT_FORMAT_BGR 0
+#define FACEDETECT_FORMAT_RGB 1
+#define FACEDETECT_FORMAT_BGRA 2
+#define FACEDETECT_FORMAT_RGBA 3
+#define FACEDETECT_FORMAT_GRAY 4
+
+//detection heads, finest (smallest faces) first
+#define FACEDETECT_HEAD_CONV3 1
+#define FACEDETECT_HEAD_CONV4 2
+#define FACEDETECT_HEAD_CONV5 4
+#define FACEDETECT_HEAD_CONV6 8
+#define FACEDETECT_HEAD_ALL 15
+
+FACEDETECTION_EXPORT int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
+                    unsigned char * rgb_image_data, int width, int height, int step, //input image, it must be BGR (three channels) insteed of RGB image!
+                    int precision); //one of FACEDETECT_PRECISION_*
+
+//state kept between calls, e.g. the prior boxes of the last input size.
+//a workspace must not be used by two threads at the same time.
+struct FaceDetectWorkspace;
+
+FACEDETECTION_EXPORT FaceDetectWorkspace * facedetect_create_workspace();
+FACEDETECTION_EXPORT void facedetect_release_workspace(FaceDetectWorkspace * workspace);
+
+//only report faces whose larger side is within [min_size, max_size] pixels, 0 disables a limit.
+//detection heads whose priors cannot produce such faces are not computed.
+FACEDETECTION_EXPORT void facedetect_set_face_size_range(FaceDetectWorkspace * workspace, int min_size, int max_size);
+
+FACEDETECTION_EXPORT int * facedetect_cnn(unsigned char * result_buffer, //buffer memory for storing face detection results, !!its size must be 0x20000 Bytes!!
+                    unsigned char * rgb_image_data, int width, int height, int step, //input image, it must be BGR (three channels) insteed of RGB image!
+                    int precision, //one of FACEDETECT_PRECISION_*
+                    FaceDetectWorkspace * workspace); //if NULL, a workspace owned by the calling thread is used
+
+//per-layer profile of the calls made with a workspace: time, bytes read and written and
+//floating-point operations of every step of the network. enabling clears the previous profile.
+#define FACEDETECT_PROFILE_TABLE 0
+#define FACEDETECT_PROFILE_JSON 1
+
+FACEDETECTION_EXPORT void facedetect_set_profiling(FaceDetectWorkspace * workspace, int enable);
+
+//write the profile as zero-terminated text in one of the FACEDETECT_PROFILE_* formats to buffer.
+//returns the length of the complete text without the terminator, like snprintf(), -1 on failure.
+FACEDETECTION_EXPORT int facedetect_profile_report(FaceDetectWorkspace * workspace, int format, char * buffer, int size);
+
+//video mode for a fixed camera: each frame is compared with the previous one in tiles of 32x32
+//pixels and only the parts of the backbone feature maps that depend on changed tiles are
+//recomputed, the heads and the detection output run on the whole frame. the results are the
+//same as without it. only single FP32 images use it, enabling or disabling drops the last frame.
+FACEDETECTION_EXPORT void facedetect_set_video_mode(FaceDetectWorkspace * workspace, int enable);
+
+//use the network weights of a model file instead of the ones compiled into the library. the file
+//holds the weights in the layout the kernels read them, including the packed INT8 weights. it is
+//mapped and its pages are used directly, so all processes using the same file share one copy.
+//it must be called before the first detection of the process. returns 0 on success, -1 if the
+//file cannot be used, the embedded weights are used then. if the environment variable
+//FACEDETECT_MODEL names a model file, it is loaded the same way before the first detection.
+FACEDETECTION_EXPORT int facedetect_load_model(const char * filename);
+
+//write the embedded weights to a model file for facedetect_load_model().
+//returns 0 on success, -1 on failure.
+FACEDETECTION_EXPORT int facedetect_save_model(const char * filename);
+
+//a detected face in pixels of the input image
+struct FaceDetection
+{
+    float confidence; //0 to 100, the score of the records of facedetect_cnn()
+    int x;
+    int y;
+    int w;
+    int h;
+    int landmarks[10]; //x and y of the eyes, the nose and the corners of the mouth
+};
+
+//the network reports at most this many faces per image
+#define FACEDETECT_MAX_FACES 100
+
+//detect faces without the result buffer, the faces with a confidence above min_confidence are
+//written directly to faces, strongest first and at most max_faces of them. the confidence is
+//truncated to an integer for the comparison, like the records of facedetect_cnn().
+//returns the number of faces written, -1 on failure.
+FACEDETECTION_EXPORT int facedetect_cnn_faces(FaceDetection * faces, int max_faces,
+                    unsigned char * rgb_image_data, int width, int height, int step, //step in bytes
+                    int format, //one of FACEDETECT_FORMAT_*
+                    float min_confidence, //0 to 100
+                    int precision, //one of FACEDETECT_PRECISION_*
+                    FaceDetectWorkspace * workspace); //if NULL, a workspace owned by the calling thread is used
+
 /*
 DO NOT EDIT the following code if you don't really understand it.
 */
-#if defined(_ENABLE_AVX512) || defined(_ENABLE_AVX2)
+#if defined(_ENABLE_AVX512) || defined(_ENABLE_AVX2) || defined(__F16C__)
 #include <immintrin.h>
 #endif
 
@@ -83,12 +177,21 @@ DO NOT EDIT the following code if you don't really understand it.
 #if defined(_ENABLE_AVX512)&& defined(_ENABLE_AVX2)
 #error Cannot enable the two of AVX512 and AVX2 at the same time.
 #endif
+#if defined(_ENABLE_AVXVNNI)&& !defined(_ENABLE_AVX2)
+#error AVX-VNNI can only be enabled together with AVX2.
+#endif
+
+//activations are quantized to [0, 127] so that the sum of two UINT8*INT8 products
+//cannot saturate in _mm256_maddubs_epi16(). VNNI uses the same range for identical results.
+#define _MAX_INT8_ACTIVATION 127
 
 
 #if defined(_OPENMP)
 #include <omp.h>
 #endif
 
+#include <math.h>
+#include <stdint.h>
 #include <string.h>
 #include <vector>
 #include <iostream>
@@ -108,6 +211,76 @@ void myFree_(void* ptr);
 #  define MAX(a,b)  ((a) < (b) ? (b) : (a))
 #endif
 
+//IEEE half precision, only used to store activations
+typedef unsigned short float16;
+
+inline float float16ToFloat(float16 h)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    unsigned int sign = (h & 0x8000u) << 16;
+    unsigned int exponent = (h >> 10) & 0x1f;
+    unsigned int mantissa = h & 0x3ff;
+    unsigned int bits;
+    if (exponent == 0x1f) //inf or nan
+        bits = sign | 0x7f800000u | (mantissa << 13);
+    else if (exponent != 0) //normal
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0) //zero
+        bits = sign;
+    else //subnormal, normalize it
+    {
+        exponent = 113;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+        bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+#endif
+}
+
+//round to nearest even, the same as _MM_FROUND_TO_NEAREST_INT in F16C
+inline float16 floatToFloat16(float f)
+{
+#if defined(__F16C__)
+    return _cvtss_sh(f, _MM_FROUND_TO_NEAREST_INT);
+#else
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(bits));
+    unsigned int sign = (bits >> 16) & 0x8000u;
+    unsigned int absBits = bits & 0x7fffffffu;
+    if (absBits >= 0x7f800000u) //inf or nan
+        return (float16)(sign | 0x7c00u | (absBits > 0x7f800000u ? 0x200u : 0));
+    if (absBits >= 0x477ff000u) //overflow after rounding
+        return (float16)(sign | 0x7c00u);
+    if (absBits < 0x38800000u) //subnormal or zero
+    {
+        if (absBits < 0x33000000u)
+            return (float16)sign;
+        unsigned int exponent = absBits >> 23;
+        unsigned int mantissa = (absBits & 0x7fffffu) | 0x800000u;
+        unsigned int shift = 126 - exponent;
+        unsigned int half = mantissa >> shift;
+        unsigned int rem = mantissa & ((1u << shift) - 1);
+        unsigned int mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1)))
+            half++;
+        return (float16)(sign | half);
+    }
+    unsigned int half = ((absBits >> 13) - (112 << 10));
+    unsigned int rem = absBits & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (half & 1)))
+        half++;
+    return (float16)(sign | half);
+#endif
+}
+
 typedef struct FaceRect_
 {
     float score;
@@ -138,9 +311,11 @@ public:
 	int cols;
 	int channels; //in element
     int channelStep; //in byte
+    bool external; //data belongs to someone else, e.g. a mapped model file, and is not freed
 public:
 	CDataBlob() {
         data = 0;
+        external = false;
 		rows = 0;
 		cols = 0;
         channels = 0;
@@ -149,6 +324,7 @@ public:
 	CDataBlob(int r, int c, int ch)
 	{
         data = 0;
+        external = false;
         create(r, c, ch);
         //#warning "confirm later"
         //setZero();
@@ -160,18 +336,33 @@ public:
 
     void setNULL()
     {
-        if (data)
+        if (data && external)
+            data = 0;
+        else if (data)
             myFree(&data);
+        external = false;
         rows = cols = channels = channelStep = 0;
     }
 
+    //use memory that belongs to someone else and outlives the blob, step is the channelStep
+    void attach(T * pData, int r, int c, int ch, int step)
+    {
+        setNULL();
+        data = pData;
+        rows = r;
+        cols = c;
+        channels = ch;
+        channelStep = step;
+        external = true;
+    }
+
     void setZero()
     {
         if(data)
-            memset(data, 0, channelStep * rows * cols);
+            memset(data, 0, size_t(channelStep) * rows * cols);
     }
 
-    inline bool isEmpty()
+    inline bool isEmpty() const
     {
         return (rows <= 0 || cols <= 0 || channels == 0 || data == NULL);
     }
@@ -231,65 +422,16 @@ public:
         return (this->data + (size_t(r) * this->cols + c) * this->channelStep /sizeof(T));
     }
 
-    bool setDataFrom3x3S2P1to1x1S1P0FromImage(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep)
+    inline const T * ptr(int r, int c) const
     {
-        if (imgData == NULL)
-        {
-            cerr << "The input image data is null." << endl;
-            return false;
-        }
-        if (typeid(float) != typeid(T))
-        {
-            cerr << "DataBlob must be float in the current version." << endl;
-            return false;
-        }
-        if (imgChannels != 3)
-        {
-            cerr << "The input image must be a 3-channel RGB image." << endl;
-            return false;
-        }
-        //only 27 elements used for each pixel
-        create((imgHeight+1)/2, (imgWidth+1)/2, 32); 
-        //since the pixel assignment cannot fill all the elements in the blob. 
-        //some elements in the blob should be initialized to 0
-        setZero();
-
-#if defined(_OPENMP)
-#pragma omp parallel for
-#endif
-        for (int r = 0; r < this->rows; r++)
-        {
-            for (int c = 0; c < this->cols; c++)
-            {
-                T * pData = this->ptr(r, c);
-                for (int fy = -1; fy <= 1; fy++)
-                {
-                    int srcy = r * 2 + fy;
-                    
-                    if (srcy < 0 || srcy >= imgHeight) //out of the range of the image
-                        continue;
-
-                    for (int fx = -1; fx <= 1; fx++)
-                    {
-                        int srcx = c * 2 + fx;
-
-                        if (srcx < 0 || srcx >= imgWidth) //out of the range of the image
-                            continue;
-
-                        const unsigned char * pImgData = imgData + size_t(imgWidthStep) * srcy + imgChannels * srcx;
-
-                        //int output_channel_offset = ((fy + 1) * 3 + fx + 1) * 3; //3x3 filters, 3-channel image
-                        int output_channel_offset = ((fy + 1) * 3 + fx + 1) ; //3x3 filters, 3-channel image
-                        pData[output_channel_offset] = (pImgData[0]);
-                        pData[output_channel_offset+9] = (pImgData[1]);
-                        pData[output_channel_offset+18] = (pImgData[2]);
-                    }
-                }
-            }
-        }
-        return true;
+        return const_cast<CDataBlob *>(this)->ptr(r, c);
     }
 
+    //the image has 1 (gray), 3 or 4 channels, blue first unless rgbOrder is set. a fourth
+    //channel is ignored.
+    bool setDataFrom3x3S2P1to1x1S1P0FromImage(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep,
+                                              bool rgbOrder = false);
+
     inline T getElement(int r, int c, int ch)
     {
         if (this->data)
@@ -346,6 +488,43 @@ public:
     }
 };
 
+//row of the blob of setDataFrom3x3S2P1to1x1S1P0FromImage(): pixel c receives the 27 values of the
+//3x3 patch around image pixel (2 * row, 2 * c), blue, green and red one after another and each by
+//rows, followed by zeros up to outPixelStep. pixels outside the image are zero.
+void imagePatchRow(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep, bool rgbOrder,
+                   int row, float * pOut, int cols, int outPixelStep);
+
+template <typename T>
+bool CDataBlob<T>::setDataFrom3x3S2P1to1x1S1P0FromImage(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep,
+                                                        bool rgbOrder)
+{
+    if (imgData == NULL)
+    {
+        cerr << "The input image data is null." << endl;
+        return false;
+    }
+    if (typeid(float) != typeid(T))
+    {
+        cerr << "DataBlob must be float in the current version." << endl;
+        return false;
+    }
+    if (imgChannels != 1 && imgChannels != 3 && imgChannels != 4)
+    {
+        cerr << "The input image must be a 1-, 3- or 4-channel image." << endl;
+        return false;
+    }
+    //only 27 elements used for each pixel, the others are set to 0
+    create((imgHeight+1)/2, (imgWidth+1)/2, 32);
+
+#if defined(_OPENMP)
+#pragma omp parallel for
+#endif
+    for (int r = 0; r < this->rows; r++)
+        imagePatchRow(imgData, imgWidth, imgHeight, imgChannels, imgWidthStep, rgbOrder,
+                      r, (float *)this->ptr(r, 0), this->cols, this->channelStep / sizeof(T));
+    return true;
+}
+
 template <typename T>
 class Filters{
   public:
@@ -356,6 +535,11 @@ class Filters{
     bool with_relu;
     CDataBlob<T> weights;
     CDataBlob<T> biases;
+    //INT8 copy of the point-wise weights with one scale per filter (weight = qweight * qscale)
+    CDataBlob<signed char> qweights;
+    CDataBlob<float> qscales;
+    //qweights in the order the SIMD kernel reads them, see pack()
+    CDataBlob<signed char> qpacked;
 
     Filters()
     {
@@ -411,23 +595,151 @@ class Filters{
                     channels * sizeof(T));
         memcpy(this->biases.ptr(0,0), convinfo.pBiases, sizeof(T) * this->num_filters);
 
+        if(this->is_pointwise)
+            quantize();
+
         return *this;
     }
+
+    //symmetric per-filter quantization of the point-wise weights to [-127, 127]
+    void quantize()
+    {
+        this->qweights.create(1, num_filters, channels);
+        this->qweights.setZero(); //the padding must be zero for the dot products
+        this->qscales.create(1, 1, num_filters);
+
+        for(int fidx = 0; fidx < num_filters; fidx++)
+        {
+            const T * pW = this->weights.ptr(0, fidx);
+            signed char * pQ = this->qweights.ptr(0, fidx);
+
+            float maxAbs = 0.f;
+            for(int ch = 0; ch < channels; ch++)
+                maxAbs = MAX(maxAbs, fabsf(pW[ch]));
+
+            float scale = (maxAbs > 0.f) ? (127.f / maxAbs) : 1.f;
+            for(int ch = 0; ch < channels; ch++)
+                pQ[ch] = (signed char)lrintf(pW[ch] * scale);
+
+            this->qscales.data[fidx] = 1.f / scale;
+        }
+
+        pack();
+    }
+
+    //tiles of 8 filters x 4 input channels, 32 bytes each. the tiles of a group of 8 filters
+    //follow each other along the input channels, so the kernel reads the weights of 8 output
+    //channels with one aligned load per 4 input channels. missing filters are zero.
+    void pack()
+    {
+        const int groups = (num_filters + 7) / 8;
+        const int quads = (channels + 3) / 4;
+
+        this->qpacked.create(1, 1, groups * quads * 32);
+        this->qpacked.setZero();
+
+        for(int fidx = 0; fidx < num_filters; fidx++)
+        {
+            const signed char * pQ = this->qweights.ptr(0, fidx);
+            signed char * pTiles = this->qpacked.data + size_t(fidx / 8) * quads * 32 + (fidx % 8) * 4;
+
+            for(int ch = 0; ch < channels; ch++)
+                pTiles[(ch / 4) * 32 + ch % 4] = pQ[ch];
+        }
+    }
 };
 
 
-bool convolution(CDataBlob<float> & inputData, Filters<float> & filters, CDataBlob<float> & outputData, bool do_relu = true);
-bool convolutionDP(CDataBlob<float> & inputData, 
-                Filters<float> & filtersP, Filters<float> & filtersD, 
-                CDataBlob<float> & outputData, bool do_relu = true);
-bool convolution4layerUnit(CDataBlob<float> & inputData, 
-                Filters<float> & filtersP1, Filters<float> & filtersD1, 
-                Filters<float> & filtersP2, Filters<float> & filtersD2, 
-                CDataBlob<float> & outputData, bool do_relu = true);
+//model files hold the blobs of the filters as they are stored in memory. all values are
+//little-endian, offsets are from the start of the file. the data of a blob is rows x cols
+//pixels of channelStep bytes each, with zero padding. the offsets and the channel steps are
+//multiples of FACEDETECT_MODEL_ALIGN, which suits all SIMD widths.
+#define FACEDETECT_MODEL_MAGIC 0x4d44464c //"LFDM"
+#define FACEDETECT_MODEL_VERSION 1
+#define FACEDETECT_MODEL_ALIGN 64
 
-bool maxpooling2x2S2(CDataBlob<float> &inputData, CDataBlob<float> &outputData);
+typedef struct ModelFileHeader_
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_layers; //followed by num_layers ModelFileLayer
+    uint32_t align;
+}ModelFileHeader;
 
-bool upsamplex2withadd(CDataBlob<float> &inputData, CDataBlob<float> &inputoutputData);
+typedef struct ModelFileBlob_
+{
+    uint64_t offset; //0 for an empty blob
+    int32_t rows;
+    int32_t cols;
+    int32_t channels;
+    int32_t channelStep;
+}ModelFileBlob;
+
+typedef struct ModelFileLayer_
+{
+    int32_t channels;
+    int32_t num_filters;
+    int32_t is_depthwise;
+    int32_t is_pointwise;
+    int32_t with_relu;
+    int32_t reserved;
+    ModelFileBlob blobs[5]; //weights, biases, qweights, qscales, qpacked of Filters
+}ModelFileLayer;
+
+bool convolution(CDataBlob<float> & inputData, const Filters<float> & filters, CDataBlob<float> & outputData, bool do_relu = true);
+//the flattened outputs of the detection heads, concatenated like the inputs of detection_output().
+//a head writes its num_priors priors per pixel from prior index offset on, 14 loc, 2 conf and
+//1 iou values per prior.
+typedef struct HeadOutputs_
+{
+    CDataBlob<float> * loc;
+    CDataBlob<float> * conf;
+    CDataBlob<float> * iou;
+    int num_priors;
+    int offset;
+}HeadOutputs;
+
+//the activations can be stored as float or float16, the arithmetic is always done in float.
+//if pUpsampled is given, the input is read as inputData + the x2 upsampled pUpsampled, the
+//results are the same as after upsamplex2withadd(*pUpsampled, inputData). not in INT8 mode.
+template<typename TIn, typename TOut>
+bool convolutionDP(CDataBlob<TIn> & inputData, 
+                const Filters<float> & filtersP, const Filters<float> & filtersD, 
+                CDataBlob<TOut> & outputData, bool do_relu = true,
+                int precision = FACEDETECT_PRECISION_FP32,
+                const CDataBlob<TIn> * pUpsampled = NULL);
+
+//the last layers of a detection head, convolutionDP() without ReLU whose rows are written
+//directly to the flattened outputs of the head instead of an output blob
+template<typename T>
+bool convolutionHead(CDataBlob<T> & inputData, 
+                const Filters<float> & filtersP, const Filters<float> & filtersD, 
+                const HeadOutputs & head, int precision = FACEDETECT_PRECISION_FP32,
+                const CDataBlob<T> * pUpsampled = NULL);
+template<typename TIn, typename TOut>
+bool convolution4layerUnit(CDataBlob<TIn> & inputData, 
+                const Filters<float> & filtersP1, const Filters<float> & filtersD1, 
+                const Filters<float> & filtersP2, const Filters<float> & filtersD2, 
+                CDataBlob<TOut> & outputData, bool do_relu = true,
+                int precision = FACEDETECT_PRECISION_FP32);
+
+//the first layers of the network fused row by row: the input conversion, the 3x3 stride 2
+//convolution (filters[0]), a point-wise + depth-wise pair (filters[1], filters[2]), the 2x2
+//max pooling and two more pairs (filters[3] to filters[6]). only a few rows of each
+//intermediate feature map are kept, the results are identical to the layer by layer path in FP32.
+//the image is read like in setDataFrom3x3S2P1to1x1S1P0FromImage().
+bool convolutionStem(const unsigned char * imgData, int imgWidth, int imgHeight, int imgChannels, int imgWidthStep,
+                     bool rgbOrder, const Filters<float> * filters, CDataBlob<float> & outputData);
+
+//quantize a non-negative blob to [0, _MAX_INT8_ACTIVATION], returns the scale (value = qvalue * scale)
+float quantizeActivations(CDataBlob<float> & inputData, CDataBlob<unsigned char> & outputData);
+float quantizeActivations(CDataBlob<float16> & inputData, CDataBlob<unsigned char> & outputData);
+
+template<typename T>
+bool maxpooling2x2S2(CDataBlob<T> &inputData, CDataBlob<T> &outputData);
+
+template<typename T>
+bool upsamplex2withadd(CDataBlob<T> &inputData, CDataBlob<T> &inputoutputData);
 
 template<typename T>
 bool extract(CDataBlob<T> &inputData, CDataBlob<T> &loc, CDataBlob<T> &conf, CDataBlob<T> &iou, int num_priors);
@@ -435,13 +747,14 @@ bool extract(CDataBlob<T> &inputData, CDataBlob<T> &loc, CDataBlob<T> &conf, CDa
 template<typename T>
 bool concat4(CDataBlob<T> &inputData1, CDataBlob<T> &inputData2, CDataBlob<T> &inputData3, CDataBlob<T> &inputData4, CDataBlob<T> &outputData);
 
+template<typename T>
+bool concat(CDataBlob<T> ** inputs, int num_inputs, CDataBlob<T> &outputData);
+
 bool priorbox( int feature_width, int feature_height, 
                 int img_width, int img_height, 
                 int step, int num_sizes, 
                 float * pWinSizes, CDataBlob<float> & outputData);
 
-bool softmax1vector2class(CDataBlob<float> &inputOutputData);
-
 /* the input data for softmax must be a vector, the data stored in a multi-channel blob with size 1x1 */
 template<typename T>
 bool blob2vector(CDataBlob<T> &inputData, CDataBlob<T> & outputData);
@@ -450,6 +763,24 @@ bool softmax1vector2class(CDataBlob<float> &inputOutputData);
 
 bool clamp1vector(CDataBlob<float> &inputOutputData);
 
+//the faces detection_output() reports, sizes in pixels of the image, 0 for no limit. the size
+//of a face is the larger side of its rectangle rounded like FaceRect.
+typedef struct FaceSizeRange_
+{
+    int width;
+    int height;
+    int min_size;
+    int max_size;
+
+    bool contains(float xmin, float ymin, float xmax, float ymax) const
+    {
+        const int w = int((xmax - xmin) * width + 0.5f);
+        const int h = int((ymax - ymin) * height + 0.5f);
+        const int size = w > h ? w : h;
+        return (min_size <= 0 || size >= min_size) && (max_size <= 0 || size <= max_size);
+    }
+} FaceSizeRange;
+
 bool detection_output(CDataBlob<float> & priorbox,
                       CDataBlob<float> & loc,
                       CDataBlob<float> & conf,
@@ -458,6 +789,66 @@ bool detection_output(CDataBlob<float> & priorbox,
                       float confidence_threshold,
                       int top_k,
                       int keep_top_k,
-                      CDataBlob<float> & outputData);
+                      CDataBlob<float> & outputData,
+                      const FaceSizeRange * size_range = NULL);
+
+//the accumulated costs of one step of the network, the bytes only count the data that has to
+//be read and written at least (blobs and weights), not the traffic of the implementation
+typedef struct ProfileEntry_
+{
+    const char * name;
+    int calls;
+    double milliseconds;
+    double bytesRead;
+    double bytesWritten;
+    double flops;
+}ProfileEntry;
+
+struct FaceDetectWorkspace
+{
+    //face size range in pixels, 0 means no limit
+    int minFaceSize;
+    int maxFaceSize;
+
+    //the flattened prior boxes depend only on the input size and the active heads
+    int priorWidth;
+    int priorHeight;
+    int priorHeads;
+    CDataBlob<float> priors;
+
+    //the steps in the order of their first call
+    bool profiling;
+    vector<ProfileEntry> profile;
+
+    //video mode: the last frame and the backbone outputs computed from it, those of the stem
+    //and of the units ending with conv10, conv14, conv18, conv22 and conv26
+    bool video;
+    int videoWidth;
+    int videoHeight;
+    int videoFormat;
+    vector<unsigned char> videoFrame;
+    CDataBlob<float> videoBlobs[6];
+
+    //the flattened outputs of the active heads, written by the head convolutions
+    CDataBlob<float> headLoc;
+    CDataBlob<float> headConf;
+    CDataBlob<float> headIoU;
+
+    FaceDetectWorkspace()
+    {
+        profiling = false;
+        video = false;
+        videoWidth = 0;
+        videoHeight = 0;
+        videoFormat = FACEDETECT_FORMAT_BGR;
+        minFaceSize = 0;
+        maxFaceSize = 0;
+        priorWidth = 0;
+        priorHeight = 0;
+        priorHeads = 0;
+    }
+};
 
-vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int with, int height, int step);
+vector<FaceRect> objectdetect_cnn(unsigned char * rgbImageData, int with, int height, int step,
+                                  int precision = FACEDETECT_PRECISION_FP32,
+                                  FaceDetectWorkspace * workspace = NULL);
@@ -29,6 +29,27 @@ mkdir -p "$OUTDIR"
 
 CMAKE_ARGS=(-DCMAKE_BUILD_TYPE=Release $BACKEND_ARGS)
 
+# The YuNet model is downloaded from a fixed opencv_zoo commit and only used if its SHA-256
+# matches. Without both, or if the download fails, the YuNet backend is left out (unless the
+# model was copied to libIFD/opencv).
+YUNET_COMMIT="${YUNET_COMMIT:-}"
+YUNET_SHA256="${YUNET_SHA256:-}"
+
+if [[ "$BACKEND_ARGS" =~ -DIFD_USE_OPENCV=1 ]]; then
+    YUNET_MODEL="$BUILDDIR/face_detection_yunet_2023mar.onnx"
+    YUNET_URL="https://github.com/opencv/opencv_zoo/raw/$YUNET_COMMIT/models/face_detection_yunet"
+
+    if [ -z "$YUNET_COMMIT" ] || [ -z "$YUNET_SHA256" ]; then
+        echo "YUNET_COMMIT or YUNET_SHA256 not set, not downloading the YuNet model."
+    elif ! curl -fL -o "$YUNET_MODEL" "$YUNET_URL/face_detection_yunet_2023mar.onnx"; then
+        echo "Unable to download the YuNet model, building without it."
+    elif ! echo "$YUNET_SHA256  $YUNET_MODEL" | sha256sum -c --status; then
+        echo "Checksum of the YuNet model does not match, building without it."
+    else
+        CMAKE_ARGS=(${CMAKE_ARGS[@]} -DIFD_OPENCV_YUNET_MODEL="$(pwd)/$YUNET_MODEL")
+    fi
+fi
+
 if [[ "$OSTYPE" =~ ^msys ]]; then
     CMAKE_ARGS=(${CMAKE_ARGS[@]} -G "MSYS Makefiles")
     LIBRARY_NAME="IFD.dll"
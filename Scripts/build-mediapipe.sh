@@ -47,3 +47,6 @@ bazel build --compilation_mode opt --define MEDIAPIPE_DISABLE_OPENCV=1 IFD:media
 cd "$WORKDIR"
 cp -f "$BINDIR/libmediapipe.so" "$OUTDIR/"
 cp -R "$MPDIR/mediapipe" "$OUTDIR/"
+
+curl -fL -o "$OUTDIR/mediapipe/modules/face_detection/face_detection_short_range.tflite" \
+    https://storage.googleapis.com/mediapipe-assets/face_detection_short_range.tflite
@@ -27,6 +27,8 @@
 
 #include <ifd.h>
 
+#include <algorithm>
+
 IFD_BEGIN_NAMESPACE();
 
 class Backend
@@ -46,6 +48,32 @@ public:
     auto width() const -> unsigned int { return m_width; }
     auto height() const -> unsigned int { return m_height; }
 
+    auto minimumFaceSize() const -> unsigned int { return m_minimumFaceSize; }
+    auto maximumFaceSize() const -> unsigned int { return m_maximumFaceSize; }
+
+    // Backends that can skip work for out-of-range faces override this, but must call the base
+    virtual void setFaceSizeRange(unsigned int minimum, unsigned int maximum)
+    {
+        m_minimumFaceSize = minimum;
+        m_maximumFaceSize = maximum;
+    }
+
+    auto threadCount() const -> unsigned int { return m_threadCount; }
+    auto inferenceThreadCount() const -> unsigned int { return m_inferenceThreadCount; }
+
+    // Backends with their own threads override this, but must call the base
+    virtual void setThreadCount(unsigned int threads, unsigned int inferenceThreads)
+    {
+        m_threadCount = threads;
+        m_inferenceThreadCount = inferenceThreads;
+    }
+
+    auto isProfilingEnabled() const -> bool { return m_profilingEnabled; }
+
+    // Backends with a profiler override these, but must call the base
+    virtual void setProfilingEnabled(bool enabled) { m_profilingEnabled = enabled; }
+    virtual auto profileReport(ProfileFormat) const -> std::string { return {}; }
+
     virtual auto name() const -> std::string = 0;
 
     virtual auto preferredImageFormat() const -> ImageFormat = 0;
@@ -56,9 +84,80 @@ public:
     virtual void process(std::span<const BgrPixel> image, RectList* results) const = 0;
     virtual void process(std::span<const BgraPixel> image, RectList* results) const = 0;
 
+    // Batches are processed image by image unless a backend overrides these
+    virtual void process(std::span<const std::span<const GrayscalePixel>> images,
+                         std::vector<RectList>* results) const { processEach(images, results); }
+    virtual void process(std::span<const std::span<const RgbPixel>> images,
+                         std::vector<RectList>* results) const { processEach(images, results); }
+    virtual void process(std::span<const std::span<const RgbaPixel>> images,
+                         std::vector<RectList>* results) const { processEach(images, results); }
+    virtual void process(std::span<const std::span<const BgrPixel>> images,
+                         std::vector<RectList>* results) const { processEach(images, results); }
+    virtual void process(std::span<const std::span<const BgraPixel>> images,
+                         std::vector<RectList>* results) const { processEach(images, results); }
+
+    auto isStreaming() const -> bool { return bool(m_resultCallback); }
+
+    // Backends with a pipeline override these, but must call the base
+    virtual void startStreaming(ResultCallback callback, unsigned int /*maxInFlightFrames*/)
+    {
+        m_resultCallback = std::move(callback);
+    }
+
+    virtual void stopStreaming() { m_resultCallback = nullptr; }
+
+    // Streamed frames are processed within submit() unless a backend overrides these
+    virtual void submit(std::span<const GrayscalePixel> image, uint64_t frame) const
+    { processAndDeliver(image, frame); }
+    virtual void submit(std::span<const RgbPixel> image, uint64_t frame) const
+    { processAndDeliver(image, frame); }
+    virtual void submit(std::span<const RgbaPixel> image, uint64_t frame) const
+    { processAndDeliver(image, frame); }
+    virtual void submit(std::span<const BgrPixel> image, uint64_t frame) const
+    { processAndDeliver(image, frame); }
+    virtual void submit(std::span<const BgraPixel> image, uint64_t frame) const
+    { processAndDeliver(image, frame); }
+
+protected:
+    template <typename T>
+    void processAndDeliver(std::span<const T> image, uint64_t frame) const
+    {
+        RectList results;
+        process(image, &results);
+        m_resultCallback(frame, results);
+    }
+
+    template <typename T>
+    void processEach(std::span<const std::span<const T>> images, std::vector<RectList>* results) const
+    {
+        results->resize(images.size());
+
+        for (size_t i = 0; i < images.size(); ++i)
+            process(images[i], &(*results)[i]);
+    }
+
+    // Removes faces whose larger side is outside the face size range
+    void filterFaceSizes(RectList* results) const
+    {
+        std::erase_if(*results, [this](const Rect& rect) {
+            const unsigned int size = std::max(rect.width, rect.height);
+            return size < m_minimumFaceSize || (m_maximumFaceSize > 0 && size > m_maximumFaceSize);
+        });
+    }
+
 private:
     unsigned int m_width;
     unsigned int m_height;
+
+    unsigned int m_minimumFaceSize = 0;
+    unsigned int m_maximumFaceSize = 0;
+
+    unsigned int m_threadCount = 0;
+    unsigned int m_inferenceThreadCount = 0;
+
+    bool m_profilingEnabled = false;
+
+    ResultCallback m_resultCallback;
 };
 
 IFD_END_NAMESPACE();
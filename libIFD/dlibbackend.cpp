@@ -27,7 +27,10 @@
 #undef __cpuid // Work-around for mismatch in msys headers
 #endif
 
+#include "convert.h"
+
 #include <algorithm>
+#include <cmath>
 #include <execution>
 
 // ---------------------------------------------------------------------------------------------- //
@@ -37,29 +40,87 @@ using namespace ifd;
 // ---------------------------------------------------------------------------------------------- //
 
 namespace {
-    template <typename T>
-    auto toDlibPixel(const T& pixel) -> dlib::rgb_pixel
+    // The levels run on the same scheduler as the image conversions, the standard parallel
+    // algorithms on TBB's thread pool. Unlike the conversions they can't be unsequenced, since
+    // loading a level allocates memory.
+    constexpr auto ExecutionPolicy = std::execution::par;
+
+    // Default of dlib::scan_fhog_pyramid, i.e. no limit
+    constexpr unsigned long DefaultPyramidLevels = 1000;
+
+    // Each pyramid level shrinks the image by pyramid_down<6>
+    constexpr double PyramidScale = 6.0 / 5.0;
+
+    // Lets dlib read grayscale images from the caller's memory without copying them. This is
+    // dlib's generic image interface (dlib/image_processing/generic_image.h), which
+    // scan_fhog_pyramid::load() and pyramid_down read through const_image_view. Views are only
+    // ever inputs, so they never need to be resized.
+    struct GrayscaleImageView
     {
-        return { pixel.r, pixel.g, pixel.b };
+        const GrayscalePixel* data;
+        long rows;
+        long columns;
     };
 
-    constexpr auto ExecutionPolicy = std::execution::par_unseq;
+    inline auto num_rows(const GrayscaleImageView& image) -> long
+    {
+        return image.rows;
+    }
+
+    inline auto num_columns(const GrayscaleImageView& image) -> long
+    {
+        return image.columns;
+    }
+
+    inline auto width_step(const GrayscaleImageView& image) -> long
+    {
+        return image.columns;
+    }
+
+    inline auto image_data(const GrayscaleImageView& image) -> const void*
+    {
+        return image.data;
+    }
+
+    inline auto image_data(GrayscaleImageView& image) -> void*
+    {
+        return const_cast<GrayscalePixel*>(image.data);
+    }
+
+    inline void set_image_size(GrayscaleImageView&, long, long)
+    {
+        throw Error("Image views cannot be resized.");
+    }
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-DlibBackend::DlibBackend(unsigned int width, unsigned int height)
+namespace dlib {
+    template <>
+    struct image_traits<GrayscaleImageView>
+    {
+        using pixel_type = unsigned char;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+DlibBackend::DlibBackend(unsigned int width, unsigned int height, Scheduling scheduling)
     : Backend(width, height),
+      m_scheduling(scheduling),
       m_detector(dlib::get_frontal_face_detector()),
-      m_grayscaleImage(height, width),
-      m_rgbImage(height, width)
+      m_grayscaleImage(width * height)
 {
+    updatePyramidLevels();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 auto DlibBackend::name() const -> std::string
 {
+    if (m_scheduling == Scheduling::Parallel)
+        return ParallelName;
+
     return Name;
 }
 
@@ -67,16 +128,55 @@ auto DlibBackend::name() const -> std::string
 
 auto DlibBackend::preferredImageFormat() const -> ImageFormat
 {
-    return ImageFormat::Bgr;
+    return ImageFormat::Grayscale;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DlibBackend::setFaceSizeRange(unsigned int minimum, unsigned int maximum)
+{
+    Backend::setFaceSizeRange(minimum, maximum);
+
+    // Level k of the pyramid finds faces of about window * PyramidScale^k pixels, so levels for
+    // faces above the maximum are not scanned. Smaller faces are only filtered from the results.
+    Scanner scanner;
+    scanner.copy_configuration(m_detector.get_scanner());
+
+    unsigned long levels = DefaultPyramidLevels;
+
+    if (maximum > 0)
+    {
+        const double window = scanner.get_detection_window_width();
+        const double depth = std::ceil(std::log(maximum / window) / std::log(PyramidScale));
+
+        levels = 1 + static_cast<unsigned long>(std::max(depth, 0.0));
+    }
+
+    scanner.set_max_pyramid_levels(levels);
+
+    std::vector<dlib::frontal_face_detector::feature_vector_type> weights;
+
+    for (unsigned long i = 0; i < m_detector.num_detectors(); ++i)
+        weights.push_back(m_detector.get_w(i));
+
+    m_detector = dlib::frontal_face_detector(scanner, m_detector.get_overlap_tester(), weights);
+    updatePyramidLevels();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void DlibBackend::process(std::span<const GrayscalePixel> image, RectList* results) const
 {
-    std::copy(image.begin(), image.end(), m_grayscaleImage.begin());
+    if (m_scheduling == Scheduling::Parallel)
+    {
+        detectParallel(image);
+        updateResults(results);
+        return;
+    }
 
-    m_detector(m_grayscaleImage, m_detections);
+    const GrayscaleImageView view = { image.data(), long(height()), long(width()) };
+
+    m_detector(view, m_detections);
     updateResults(results);
 }
 
@@ -84,45 +184,163 @@ void DlibBackend::process(std::span<const GrayscalePixel> image, RectList* resul
 
 void DlibBackend::process(std::span<const RgbPixel> image, RectList* results) const
 {
-    std::transform(ExecutionPolicy,
-                   image.begin(), image.end(), m_rgbImage.begin(), toDlibPixel<RgbPixel>);
-
-    m_detector(m_rgbImage, m_detections);
-    updateResults(results);
+    Convert::toGrayscale(image, m_grayscaleImage);
+    process(m_grayscaleImage, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void DlibBackend::process(std::span<const RgbaPixel> image, RectList* results) const
 {
-    std::transform(ExecutionPolicy,
-                   image.begin(), image.end(), m_rgbImage.begin(), toDlibPixel<RgbaPixel>);
-
-    m_detector(m_rgbImage, m_detections);
-    updateResults(results);
+    Convert::toGrayscale(image, m_grayscaleImage);
+    process(m_grayscaleImage, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void DlibBackend::process(std::span<const BgrPixel> image, RectList* results) const
 {
-    std::transform(ExecutionPolicy,
-                   image.begin(), image.end(), m_rgbImage.begin(), toDlibPixel<BgrPixel>);
+    Convert::toGrayscale(image, m_grayscaleImage);
+    process(m_grayscaleImage, results);
+}
 
-    m_detector(m_rgbImage, m_detections);
-    updateResults(results);
+// ---------------------------------------------------------------------------------------------- //
 
+void DlibBackend::process(std::span<const BgraPixel> image, RectList* results) const
+{
+    Convert::toGrayscale(image, m_grayscaleImage);
+    process(m_grayscaleImage, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DlibBackend::process(std::span<const BgraPixel> image, RectList* results) const
+// The same levels as scan_fhog_pyramid::load() creates for the input size
+void DlibBackend::updatePyramidLevels()
 {
-    std::transform(ExecutionPolicy,
-                   image.begin(), image.end(), m_rgbImage.begin(), toDlibPixel<BgraPixel>);
+    m_levels.clear();
+    m_filters.clear();
+    m_thresholds.clear();
 
-    m_detector(m_rgbImage, m_detections);
-    updateResults(results);
+    if (m_scheduling != Scheduling::Parallel)
+        return;
+
+    const Scanner& scanner = m_detector.get_scanner();
+    const dlib::pyramid_down<6> pyramid;
+
+    dlib::rectangle rect(0, 0, long(width()) - 1, long(height()) - 1);
+    unsigned long count = 0;
+
+    do
+    {
+        rect = pyramid.rect_down(rect);
+        ++count;
+    }
+    while (rect.width() >= scanner.get_min_pyramid_layer_width()
+           && rect.height() >= scanner.get_min_pyramid_layer_height()
+           && count < scanner.get_max_pyramid_levels());
+
+    for (unsigned long i = 0; i < count; ++i)
+    {
+        auto level = std::make_unique<PyramidLevel>();
+
+        level->index = i;
+        level->scanner.copy_configuration(scanner);
+        level->scanner.set_max_pyramid_levels(1);
+        level->detections.resize(m_detector.num_detectors());
+
+        m_levels.push_back(std::move(level));
+    }
+
+    // What object_detector derives from its weight vectors
+    for (unsigned long i = 0; i < m_detector.num_detectors(); ++i)
+    {
+        const auto& weights = m_detector.get_w(i);
+
+        m_filters.push_back(scanner.build_fhog_filterbank(weights));
+        m_thresholds.push_back(weights(scanner.get_num_dimensions()));
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DlibBackend::detectParallel(std::span<const GrayscalePixel> image) const
+{
+    const GrayscaleImageView view = { image.data(), long(height()), long(width()) };
+    const dlib::pyramid_down<6> pyramid;
+
+    // Each level is downsampled from the previous one, exactly as in the serial path
+    for (size_t i = 1; i < m_levels.size(); ++i)
+    {
+        if (i == 1)
+            pyramid(view, m_levels[i]->image);
+        else
+            pyramid(m_levels[i - 1]->image, m_levels[i]->image);
+    }
+
+    // Computing the features and applying the filters is what takes the time
+    std::for_each(ExecutionPolicy, m_levels.begin(), m_levels.end(), [&](const auto& level) {
+        if (level->index == 0)
+            level->scanner.load(view);
+        else
+            level->scanner.load(level->image);
+
+        for (size_t i = 0; i < m_filters.size(); ++i)
+        {
+            level->scanner.detect(m_filters[i], level->detections[i], m_thresholds[i]);
+
+            for (auto& detection : level->detections[i])
+                detection.second = pyramid.rect_up(detection.second, level->index);
+        }
+    });
+
+    suppressOverlaps();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Merges the detections of all levels like object_detector::operator() does. The serial scanner
+// sorts each detector's detections in scan order, these arrive sorted per level. Both sorts are
+// unstable, so detections with exactly the same score may be suppressed in a different order.
+void DlibBackend::suppressOverlaps() const
+{
+    static const auto compare = [](const Detection& a, const Detection& b) {
+        return a.first < b.first;
+    };
+
+    m_candidates.clear();
+
+    for (size_t i = 0; i < m_filters.size(); ++i)
+    {
+        m_levelDetections.clear();
+
+        for (const auto& level : m_levels)
+        {
+            m_levelDetections.insert(m_levelDetections.end(), level->detections[i].begin(),
+                                     level->detections[i].end());
+        }
+
+        std::sort(m_levelDetections.rbegin(), m_levelDetections.rend(), compare);
+
+        for (const auto& detection : m_levelDetections)
+            m_candidates.push_back({ detection.first - m_thresholds[i], i, detection.second });
+    }
+
+    if (m_filters.size() > 1)
+        std::sort(m_candidates.rbegin(), m_candidates.rend());
+
+    const auto& overlaps = m_detector.get_overlap_tester();
+    m_detections.clear();
+
+    for (const auto& candidate : m_candidates)
+    {
+        const bool suppressed = std::any_of(m_detections.begin(), m_detections.end(),
+                                            [&](const Detection& detection) {
+            return overlaps(detection.second, candidate.rect);
+        });
+
+        if (!suppressed)
+            m_detections.emplace_back(candidate.detection_confidence, candidate.rect);
+    }
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -141,6 +359,8 @@ void DlibBackend::updateResults(RectList* results) const
         if (confidence >= MinimumConfidence)
             results->emplace_back(rect.left(), rect.top(), rect.width(), rect.height());
     }
+
+    filterFaceSizes(results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -151,3 +371,11 @@ auto DlibBackend::make(unsigned int width, unsigned int height) -> std::unique_p
 }
 
 // ---------------------------------------------------------------------------------------------- //
+
+auto DlibBackend::makeParallel(unsigned int width,
+                               unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<DlibBackend>(width, height, Scheduling::Parallel);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -33,14 +33,24 @@ class DlibBackend : public Backend
 {
 public:
     static constexpr const char* Name = "Dlib";
+    static constexpr const char* ParallelName = "Dlib-Parallel";
+
+    enum class Scheduling
+    {
+        Serial,
+        Parallel // Scans the pyramid levels concurrently
+    };
 
 public:
-    DlibBackend(unsigned int width, unsigned int height);
+    DlibBackend(unsigned int width, unsigned int height,
+                Scheduling scheduling = Scheduling::Serial);
 
     auto name() const -> std::string override;
 
     auto preferredImageFormat() const -> ImageFormat override;
 
+    void setFaceSizeRange(unsigned int minimum, unsigned int maximum) override;
+
     void process(std::span<const GrayscalePixel> image, RectList* results) const override;
     void process(std::span<const RgbPixel> image, RectList* results) const override;
     void process(std::span<const RgbaPixel> image, RectList* results) const override;
@@ -48,16 +58,43 @@ public:
     void process(std::span<const BgraPixel> image, RectList* results) const override;
 
     static auto make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeParallel(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
 
 private:
+    using Scanner = dlib::frontal_face_detector::image_scanner_type;
+    using Detection = std::pair<double, dlib::rectangle>;
+
+    // A single-level scanner for each level of the detector's pyramid
+    struct PyramidLevel
+    {
+        unsigned long index;
+        Scanner scanner;
+        dlib::array2d<unsigned char> image; // Empty for level 0, which is the input
+        std::vector<std::vector<Detection>> detections; // Per detector
+    };
+
+    void updatePyramidLevels();
+
+    void detectParallel(std::span<const GrayscalePixel> image) const;
+    void suppressOverlaps() const;
+
     void updateResults(RectList* results) const;
 
 private:
+    Scheduling m_scheduling;
+
     mutable dlib::frontal_face_detector m_detector;
-    mutable std::vector<std::pair<double, dlib::rectangle>> m_detections;
+    mutable std::vector<Detection> m_detections;
+
+    std::vector<Scanner::fhog_filterbank> m_filters;
+    std::vector<double> m_thresholds;
+
+    // Scanners can't be copied or moved
+    mutable std::vector<std::unique_ptr<PyramidLevel>> m_levels;
+    mutable std::vector<Detection> m_levelDetections;
+    mutable std::vector<dlib::rect_detection> m_candidates;
 
-    mutable dlib::array2d<unsigned char> m_grayscaleImage;
-    mutable dlib::array2d<dlib::rgb_pixel> m_rgbImage;
+    mutable std::vector<GrayscalePixel> m_grayscaleImage;
 };
 
 IFD_END_NAMESPACE();
@@ -23,12 +23,122 @@
 
 #include "dummybackend.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <numbers>
+#include <numeric>
+#include <sstream>
+#include <thread>
+
 // ---------------------------------------------------------------------------------------------- //
 
 using namespace ifd;
 
 // ---------------------------------------------------------------------------------------------- //
 
+namespace {
+    constexpr const char* LoadVariable = "IFD_DUMMY_LOAD";
+
+    // The probability that the number of faces changes in a frame
+    constexpr double FaceCountChange = 0.05;
+
+    auto toFormat(const std::string& value) -> ImageFormat
+    {
+        if (value == "gray")
+            return ImageFormat::Grayscale;
+
+        if (value == "rgb")
+            return ImageFormat::Rgb;
+
+        if (value == "rgba")
+            return ImageFormat::Rgba;
+
+        if (value == "bgr")
+            return ImageFormat::Bgr;
+
+        if (value == "bgra")
+            return ImageFormat::Bgra;
+
+        throw std::invalid_argument(value);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DummyBackend::Load::parse(const std::string& text) -> Load
+{
+    Load load;
+
+    std::istringstream settings(text);
+    std::string setting;
+
+    while (std::getline(settings, setting, ','))
+    {
+        const size_t separator = setting.find('=');
+
+        const std::string key = setting.substr(0, separator);
+        const std::string value = separator != std::string::npos ? setting.substr(separator + 1)
+                                                                 : std::string();
+        try {
+            if (key == "latency")
+                load.latency = std::stod(value);
+            else if (key == "jitter")
+                load.jitter = std::stod(value);
+            else if (key == "wait" && (value == "sleep" || value == "spin"))
+                load.wait = value == "spin" ? Wait::Spin : Wait::Sleep;
+            else if (key == "threads")
+                load.threads = std::stoul(value);
+            else if (key == "faces")
+            {
+                const size_t range = value.find('-');
+                load.minimumFaces = std::stoul(value.substr(0, range));
+                load.maximumFaces = range != std::string::npos ? std::stoul(value.substr(range + 1))
+                                                               : load.minimumFaces;
+            }
+            else if (key == "speed")
+                load.speed = std::stod(value);
+            else if (key == "read")
+                load.readPixels = std::stoul(value) != 0;
+            else if (key == "format")
+                load.format = toFormat(value);
+            else if (key == "seed")
+                load.seed = std::stoul(value);
+            else
+                throw std::invalid_argument(key);
+        }
+        catch (const std::logic_error&) {
+            throw Error("Invalid load setting: " + setting);
+        }
+    }
+
+    if (load.latency < 0.0 || load.jitter < 0.0 || load.threads == 0
+            || load.minimumFaces > load.maximumFaces)
+        throw Error("Invalid load settings: " + text);
+
+    return load;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto DummyBackend::Load::fromEnvironment() -> Load
+{
+    const char* variable = std::getenv(LoadVariable);
+
+    if (!variable)
+        return {};
+
+    try {
+        return parse(variable);
+    }
+    catch (const Error& error) {
+        throw Error(std::string(LoadVariable) + ": " + error.what());
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 DummyBackend::DummyBackend(unsigned int width, unsigned int height)
     : Backend(width, height)
 {
@@ -36,8 +146,21 @@ DummyBackend::DummyBackend(unsigned int width, unsigned int height)
 
 // ---------------------------------------------------------------------------------------------- //
 
+DummyBackend::DummyBackend(unsigned int width, unsigned int height, const Load& load)
+    : Backend(width, height),
+      m_load(load),
+      m_random(load.seed)
+{
+    updateFaceCount();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto DummyBackend::name() const -> std::string
 {
+    if (m_load)
+        return LoadName;
+
     return Name;
 }
 
@@ -45,42 +168,45 @@ auto DummyBackend::name() const -> std::string
 
 auto DummyBackend::preferredImageFormat() const -> ImageFormat
 {
+    if (m_load)
+        return m_load->format;
+
     return ImageFormat::Grayscale;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DummyBackend::process(std::span<const GrayscalePixel>, RectList* results) const
+void DummyBackend::process(std::span<const GrayscalePixel> image, RectList* results) const
 {
-    updateResults(results);
+    simulate(image, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DummyBackend::process(std::span<const RgbPixel>, RectList* results) const
+void DummyBackend::process(std::span<const RgbPixel> image, RectList* results) const
 {
-    updateResults(results);
+    simulate(image, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DummyBackend::process(std::span<const RgbaPixel>, RectList* results) const
+void DummyBackend::process(std::span<const RgbaPixel> image, RectList* results) const
 {
-    updateResults(results);
+    simulate(image, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DummyBackend::process(std::span<const BgrPixel>, RectList* results) const
+void DummyBackend::process(std::span<const BgrPixel> image, RectList* results) const
 {
-    updateResults(results);
+    simulate(image, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void DummyBackend::process(std::span<const BgraPixel>, RectList* results) const
+void DummyBackend::process(std::span<const BgraPixel> image, RectList* results) const
 {
-    updateResults(results);
+    simulate(image, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -92,6 +218,147 @@ auto DummyBackend::make(unsigned int width, unsigned int height) -> std::unique_
 
 // ---------------------------------------------------------------------------------------------- //
 
+auto DummyBackend::makeLoad(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<DummyBackend>(width, height, Load::fromEnvironment());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+template <typename T>
+void DummyBackend::simulate(std::span<const T> image, RectList* results) const
+{
+    if (!m_load)
+    {
+        updateResults(results);
+        return;
+    }
+
+    if (m_load->readPixels)
+    {
+        const auto bytes = std::as_bytes(image);
+        readPixels({ reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size() });
+    }
+
+    wait();
+    moveFaces(results);
+
+    filterFaceSizes(results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DummyBackend::readPixels(std::span<const uint8_t> data) const
+{
+    m_checksum = std::accumulate(data.begin(), data.end(), m_checksum);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DummyBackend::wait() const
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::normal_distribution<double> latency(m_load->latency, m_load->jitter);
+    const std::chrono::duration<double, std::milli> duration(std::max(latency(m_random), 0.0));
+
+    if (m_load->wait == Load::Wait::Sleep)
+    {
+        std::this_thread::sleep_for(duration);
+        return;
+    }
+
+    const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(duration);
+
+    const auto spin = [&] {
+        while (Clock::now() < deadline)
+            ;
+    };
+
+    // A thread pool may run fewer tasks at a time than asked for, so the calling thread spins
+    // together with threads of its own, which always keeps the given number of threads busy
+    std::vector<std::jthread> threads;
+
+    for (unsigned int i = 1; i < m_load->threads; ++i)
+        threads.emplace_back(spin);
+
+    spin();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The faces move in straight lines and bounce off the image borders
+void DummyBackend::moveFaces(RectList* results) const
+{
+    std::bernoulli_distribution change(FaceCountChange);
+
+    if (change(m_random))
+        updateFaceCount();
+
+    results->clear();
+
+    for (auto& face : m_faces)
+    {
+        const double maximumX = width() - face.size;
+        const double maximumY = height() - face.size;
+
+        face.x += face.dx;
+        face.y += face.dy;
+
+        if (face.x < 0.0 || face.x > maximumX)
+        {
+            face.dx = -face.dx;
+            face.x = std::clamp(face.x, 0.0, maximumX);
+        }
+
+        if (face.y < 0.0 || face.y > maximumY)
+        {
+            face.dy = -face.dy;
+            face.y = std::clamp(face.y, 0.0, maximumY);
+        }
+
+        const auto x = static_cast<unsigned int>(face.x);
+        const auto y = static_cast<unsigned int>(face.y);
+
+        results->emplace_back(x, y, face.size, face.size);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void DummyBackend::updateFaceCount() const
+{
+    std::uniform_int_distribution<unsigned int> count(m_load->minimumFaces,
+                                                      m_load->maximumFaces);
+    const unsigned int target = count(m_random);
+
+    if (m_faces.size() > target)
+        m_faces.resize(target);
+
+    const unsigned int maximumSize = std::max(std::min(width(), height()) / 3, 1u);
+    const unsigned int minimumSize = std::max(maximumSize / 3, 1u);
+
+    std::uniform_int_distribution<unsigned int> size(minimumSize, maximumSize);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::uniform_real_distribution<double> angle(0.0, 2.0 * std::numbers::pi);
+
+    while (m_faces.size() < target)
+    {
+        Face face;
+        face.size = size(m_random);
+        face.x = unit(m_random) * (width() - face.size);
+        face.y = unit(m_random) * (height() - face.size);
+
+        const double direction = angle(m_random);
+        face.dx = m_load->speed * std::cos(direction);
+        face.dy = m_load->speed * std::sin(direction);
+
+        m_faces.push_back(face);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void DummyBackend::updateResults(RectList* results) const
 {
     const unsigned int w = width() / 8;
@@ -101,6 +368,8 @@ void DummyBackend::updateResults(RectList* results) const
 
     results->clear();
     results->emplace_back(x, y, w, h);
+
+    filterFaceSizes(results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -25,15 +25,50 @@
 
 #include "backend.h"
 
+#include <optional>
+#include <random>
+
 IFD_BEGIN_NAMESPACE();
 
 class DummyBackend : public Backend
 {
 public:
     static constexpr const char* Name = "Dummy";
+    static constexpr const char* LoadName = "Dummy-Load";
+
+    // A synthetic workload for measuring the rest of the pipeline. Settings are parsed from
+    // comma-separated text, e.g. "latency=30,jitter=5,wait=spin,threads=2,faces=0-3,speed=4,
+    // read=1,format=rgb". "Dummy-Load" reads them from the environment variable IFD_DUMMY_LOAD.
+    struct Load
+    {
+        enum class Wait
+        {
+            Sleep,
+            Spin // Burns the given number of threads for the duration
+        };
+
+        double latency = 20.0; // Mean in milliseconds, normally distributed
+        double jitter = 5.0;   // Standard deviation in milliseconds
+
+        Wait wait = Wait::Sleep;
+        unsigned int threads = 1;
+
+        unsigned int minimumFaces = 1; // The count changes every few frames
+        unsigned int maximumFaces = 3;
+        double speed = 4.0; // Pixels per frame
+
+        bool readPixels = true; // Reads every byte of the image once
+        ImageFormat format = ImageFormat::Grayscale;
+
+        unsigned int seed = 0;
+
+        static auto parse(const std::string& settings) -> Load;
+        static auto fromEnvironment() -> Load;
+    };
 
 public:
     DummyBackend(unsigned int width, unsigned int height);
+    DummyBackend(unsigned int width, unsigned int height, const Load& load);
 
     auto name() const -> std::string override;
 
@@ -46,9 +81,34 @@ public:
     void process(std::span<const BgraPixel> image, RectList* results) const override;
 
     static auto make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeLoad(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
 
 private:
+    struct Face
+    {
+        double x;
+        double y;
+        double dx;
+        double dy;
+        unsigned int size;
+    };
+
+    template <typename T>
+    void simulate(std::span<const T> image, RectList* results) const;
+
+    void readPixels(std::span<const uint8_t> data) const;
+    void wait() const;
+    void moveFaces(RectList* results) const;
+    void updateFaceCount() const;
+
     void updateResults(RectList* results) const;
+
+private:
+    std::optional<Load> m_load;
+
+    mutable std::mt19937 m_random;
+    mutable std::vector<Face> m_faces;
+    mutable uint64_t m_checksum = 0; // Keeps the pixel reads from being optimized away
 };
 
 IFD_END_NAMESPACE();
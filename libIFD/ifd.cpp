@@ -33,6 +33,9 @@
 #ifdef IFD_USE_OPENCV
 #include "opencvbackend.h"
 #endif
+#ifdef IFD_USE_OPENCV_YUNET
+#include "yunetbackend.h"
+#endif
 
 #include "dummybackend.h"
 
@@ -117,6 +120,81 @@ auto FaceDetector::preferredImageFormat() const -> ImageFormat
 
 // ---------------------------------------------------------------------------------------------- //
 
+void FaceDetector::setFaceSizeRange(unsigned int minimum, unsigned int maximum)
+{
+    if (maximum > 0 && minimum > maximum)
+        throw Error("Minimum face size must not exceed maximum face size.");
+
+    std::lock_guard lock(d->mutex);
+    d->backend->setFaceSizeRange(minimum, maximum);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::minimumFaceSize() const -> unsigned int
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->minimumFaceSize();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::maximumFaceSize() const -> unsigned int
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->maximumFaceSize();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::setThreadCount(unsigned int threads, unsigned int inferenceThreads)
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->setThreadCount(threads, inferenceThreads);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::threadCount() const -> unsigned int
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->threadCount();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::inferenceThreadCount() const -> unsigned int
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->inferenceThreadCount();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::setProfilingEnabled(bool enabled)
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->setProfilingEnabled(enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::isProfilingEnabled() const -> bool
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->isProfilingEnabled();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::profileReport(ProfileFormat format) const -> std::string
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->profileReport(format);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void FaceDetector::process(std::span<const GrayscalePixel> image, RectList* results) const
 {
     std::lock_guard lock(d->mutex);
@@ -157,6 +235,144 @@ void FaceDetector::process(std::span<const BgraPixel> image, RectList* results)
 
 // ---------------------------------------------------------------------------------------------- //
 
+void FaceDetector::process(std::span<const std::span<const GrayscalePixel>> images,
+                           std::vector<RectList>* results) const
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->process(images, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::process(std::span<const std::span<const RgbPixel>> images,
+                           std::vector<RectList>* results) const
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->process(images, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::process(std::span<const std::span<const RgbaPixel>> images,
+                           std::vector<RectList>* results) const
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->process(images, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::process(std::span<const std::span<const BgrPixel>> images,
+                           std::vector<RectList>* results) const
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->process(images, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::process(std::span<const std::span<const BgraPixel>> images,
+                           std::vector<RectList>* results) const
+{
+    std::lock_guard lock(d->mutex);
+    d->backend->process(images, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::startStreaming(ResultCallback callback, unsigned int maxInFlightFrames)
+{
+    if (!callback)
+        throw Error("Streaming requires a result callback.");
+
+    std::lock_guard lock(d->mutex);
+
+    if (d->backend->isStreaming())
+        d->backend->stopStreaming();
+
+    d->backend->startStreaming(std::move(callback), std::max(maxInFlightFrames, 1u));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::stopStreaming()
+{
+    std::lock_guard lock(d->mutex);
+
+    if (d->backend->isStreaming())
+        d->backend->stopStreaming();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto FaceDetector::isStreaming() const -> bool
+{
+    std::lock_guard lock(d->mutex);
+    return d->backend->isStreaming();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::submit(std::span<const GrayscalePixel> image, uint64_t frame) const
+{
+    std::lock_guard lock(d->mutex);
+
+    if (!d->backend->isStreaming())
+        throw Error("Streaming has not been started.");
+
+    d->backend->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::submit(std::span<const RgbPixel> image, uint64_t frame) const
+{
+    std::lock_guard lock(d->mutex);
+
+    if (!d->backend->isStreaming())
+        throw Error("Streaming has not been started.");
+
+    d->backend->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::submit(std::span<const RgbaPixel> image, uint64_t frame) const
+{
+    std::lock_guard lock(d->mutex);
+
+    if (!d->backend->isStreaming())
+        throw Error("Streaming has not been started.");
+
+    d->backend->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::submit(std::span<const BgrPixel> image, uint64_t frame) const
+{
+    std::lock_guard lock(d->mutex);
+
+    if (!d->backend->isStreaming())
+        throw Error("Streaming has not been started.");
+
+    d->backend->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void FaceDetector::submit(std::span<const BgraPixel> image, uint64_t frame) const
+{
+    std::lock_guard lock(d->mutex);
+
+    if (!d->backend->isStreaming())
+        throw Error("Streaming has not been started.");
+
+    d->backend->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto FaceDetector::getAvailableBackends() -> std::vector<std::string>
 {
     const FactoryList& factories = Private::getFactories();
@@ -184,17 +400,25 @@ auto FaceDetector::Private::getFactories() -> const FactoryList&
     static const FactoryList factories = {
 #ifdef IFD_USE_LIBFACEDETECTION
         { LibFaceDetectionBackend::Name, LibFaceDetectionBackend::make },
+        { LibFaceDetectionBackend::Int8Name, LibFaceDetectionBackend::makeInt8 },
+        { LibFaceDetectionBackend::Float16Name, LibFaceDetectionBackend::makeFloat16 },
 #endif
 #ifdef IFD_USE_MEDIAPIPE
         { MediaPipeBackend::Name, MediaPipeBackend::make },
+        { MediaPipeBackend::ShortRangeName, MediaPipeBackend::makeShortRange },
+#endif
+#ifdef IFD_USE_OPENCV_YUNET
+        { YuNetBackend::Name, YuNetBackend::make },
 #endif
 #ifdef IFD_USE_OPENCV
         { OpenCVBackend::Name, OpenCVBackend::make },
 #endif
 #ifdef IFD_USE_DLIB
         { DlibBackend::Name, DlibBackend::make },
+        { DlibBackend::ParallelName, DlibBackend::makeParallel },
 #endif
-        { DummyBackend::Name, DummyBackend::make }
+        { DummyBackend::Name, DummyBackend::make },
+        { DummyBackend::LoadName, DummyBackend::makeLoad }
     };
 
     return factories;
@@ -36,9 +36,11 @@
 // ---------------------------------------------------------------------------------------------- //
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <span>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 // ---------------------------------------------------------------------------------------------- //
@@ -56,6 +58,12 @@ enum class ImageFormat
     Bgra
 };
 
+enum class ProfileFormat
+{
+    Table,
+    Json
+};
+
 using GrayscalePixel = uint8_t;
 
 struct RgbPixel
@@ -104,6 +112,9 @@ struct Rect
 using RectList = std::vector<Rect>;
 using Error = std::runtime_error;
 
+// Receives the faces found in a streamed frame along with the id passed to submit()
+using ResultCallback = std::function<void(uint64_t frame, const RectList& results)>;
+
 // ---------------------------------------------------------------------------------------------- //
 
 class IFD_EXPORT FaceDetector
@@ -126,12 +137,64 @@ public:
 
     auto preferredImageFormat() const -> ImageFormat;
 
+    // Only faces whose larger side lies within [minimum, maximum] pixels are reported, 0 means
+    // no limit. Depending on the backend, this also skips work for faces outside the range.
+    void setFaceSizeRange(unsigned int minimum, unsigned int maximum);
+
+    auto minimumFaceSize() const -> unsigned int;
+    auto maximumFaceSize() const -> unsigned int;
+
+    // Limits the threads of backends that schedule work on their own threads, 0 means the
+    // backend's default. inferenceThreads applies to each inference of backends running a
+    // network with its own thread pool. Other backends ignore this.
+    void setThreadCount(unsigned int threads, unsigned int inferenceThreads = 0);
+
+    auto threadCount() const -> unsigned int;
+    auto inferenceThreadCount() const -> unsigned int;
+
+    // Records the time, memory traffic and arithmetic of every step of the backend for the
+    // images processed while enabled. Enabling clears the previous profile. Backends without a
+    // profiler return an empty report.
+    void setProfilingEnabled(bool enabled);
+    auto isProfilingEnabled() const -> bool;
+
+    auto profileReport(ProfileFormat format = ProfileFormat::Table) const -> std::string;
+
     void process(std::span<const GrayscalePixel> image, RectList* results) const;
     void process(std::span<const RgbPixel> image, RectList* results) const;
     void process(std::span<const RgbaPixel> image, RectList* results) const;
     void process(std::span<const BgrPixel> image, RectList* results) const;
     void process(std::span<const BgraPixel> image, RectList* results) const;
 
+    // Processes several images at once, (*results)[i] receives the faces of images[i]. Backends
+    // that support it run the images through the network together, others one by one.
+    void process(std::span<const std::span<const GrayscalePixel>> images,
+                 std::vector<RectList>* results) const;
+    void process(std::span<const std::span<const RgbPixel>> images,
+                 std::vector<RectList>* results) const;
+    void process(std::span<const std::span<const RgbaPixel>> images,
+                 std::vector<RectList>* results) const;
+    void process(std::span<const std::span<const BgrPixel>> images,
+                 std::vector<RectList>* results) const;
+    void process(std::span<const std::span<const BgraPixel>> images,
+                 std::vector<RectList>* results) const;
+
+    // Streaming: frames passed to submit() are processed asynchronously and the callback receives
+    // their results in submission order, on a thread of the backend. submit() blocks while the
+    // maximum number of frames is in flight, and the image data must remain valid until its
+    // results were delivered. The callback must not call into the detector. Backends without a
+    // pipeline process each frame within submit(). Stopping waits for all submitted frames.
+    void startStreaming(ResultCallback callback, unsigned int maxInFlightFrames = 2);
+    void stopStreaming();
+
+    auto isStreaming() const -> bool;
+
+    void submit(std::span<const GrayscalePixel> image, uint64_t frame) const;
+    void submit(std::span<const RgbPixel> image, uint64_t frame) const;
+    void submit(std::span<const RgbaPixel> image, uint64_t frame) const;
+    void submit(std::span<const BgrPixel> image, uint64_t frame) const;
+    void submit(std::span<const BgraPixel> image, uint64_t frame) const;
+
     static auto getAvailableBackends() -> std::vector<std::string>;
     static auto getDefaultBackend() -> std::string;
 
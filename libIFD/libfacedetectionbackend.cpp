@@ -21,7 +21,6 @@
 //                                                                                                //
 // ============================================================================================== //
 
-#include "convert.h"
 #include "libfacedetectionbackend.h"
 
 #include <facedetectcnn.h>
@@ -33,22 +32,37 @@ using namespace ifd;
 // ---------------------------------------------------------------------------------------------- //
 
 namespace {
-    static constexpr size_t BufferSize = 0x20000;
+    constexpr float MinimumConfidence = 50.0f;
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-LibFaceDetectionBackend::LibFaceDetectionBackend(unsigned int width, unsigned int height)
+LibFaceDetectionBackend::LibFaceDetectionBackend(unsigned int width, unsigned int height,
+                                                 Precision precision)
     : Backend(width, height),
-      m_buffer(BufferSize),
-      m_image(width * height)
+      m_precision(precision),
+      m_workspace(facedetect_create_workspace()),
+      m_faces(FACEDETECT_MAX_FACES)
 {
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
+LibFaceDetectionBackend::~LibFaceDetectionBackend()
+{
+    facedetect_release_workspace(m_workspace);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 auto LibFaceDetectionBackend::name() const -> std::string
 {
+    if (m_precision == Precision::Int8)
+        return Int8Name;
+
+    if (m_precision == Precision::Float16)
+        return Float16Name;
+
     return Name;
 }
 
@@ -61,74 +75,124 @@ auto LibFaceDetectionBackend::preferredImageFormat() const -> ImageFormat
 
 // ---------------------------------------------------------------------------------------------- //
 
+void LibFaceDetectionBackend::setFaceSizeRange(unsigned int minimum, unsigned int maximum)
+{
+    Backend::setFaceSizeRange(minimum, maximum);
+
+    // Also skips the detection heads that cannot produce faces in this range
+    facedetect_set_face_size_range(m_workspace, static_cast<int>(minimum),
+                                   static_cast<int>(maximum));
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void LibFaceDetectionBackend::setProfilingEnabled(bool enabled)
+{
+    Backend::setProfilingEnabled(enabled);
+    facedetect_set_profiling(m_workspace, enabled);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto LibFaceDetectionBackend::profileReport(ProfileFormat format) const -> std::string
+{
+    const int type = (format == ProfileFormat::Json) ? FACEDETECT_PROFILE_JSON
+                                                     : FACEDETECT_PROFILE_TABLE;
+
+    const int length = facedetect_profile_report(m_workspace, type, nullptr, 0);
+
+    if (length <= 0)
+        return {};
+
+    std::string report(length, '\0');
+    facedetect_profile_report(m_workspace, type, report.data(), length + 1);
+
+    return report;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void LibFaceDetectionBackend::process(std::span<const GrayscalePixel> image,
                                       RectList* results) const
 {
-    Convert::toBgr(image, m_image);
-    process(m_image, results);
+    processImage(image, FACEDETECT_FORMAT_GRAY, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void LibFaceDetectionBackend::process(std::span<const RgbPixel> image, RectList* results) const
 {
-    Convert::toBgr(image, m_image);
-    process(m_image, results);
+    processImage(image, FACEDETECT_FORMAT_RGB, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void LibFaceDetectionBackend::process(std::span<const RgbaPixel> image, RectList* results) const
 {
-    Convert::toBgr(image, m_image);
-    process(m_image, results);
+    processImage(image, FACEDETECT_FORMAT_RGBA, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void LibFaceDetectionBackend::process(std::span<const BgrPixel> image, RectList* results) const
 {
-    static constexpr int MinimumConfidence = 50;
-    static constexpr int RecordsStride = 142;
+    processImage(image, FACEDETECT_FORMAT_BGR, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void LibFaceDetectionBackend::process(std::span<const BgraPixel> image, RectList* results) const
+{
+    processImage(image, FACEDETECT_FORMAT_BGRA, results);
+}
 
-    results->clear();
+// ---------------------------------------------------------------------------------------------- //
 
+template <typename T>
+void LibFaceDetectionBackend::processImage(std::span<const T> image, int format,
+                                           RectList* results) const
+{
     auto data = const_cast<unsigned char*>(reinterpret_cast<const unsigned char*>(image.data()));
 
     const unsigned int width = this->width();
     const unsigned int height = this->height();
 
-    int* ptr = facedetect_cnn(m_buffer.data(), data, width, height, width * sizeof(BgrPixel));
+    const int count = facedetect_cnn_faces(m_faces.data(), FACEDETECT_MAX_FACES, data, width, height,
+                                           width * sizeof(T), format, MinimumConfidence,
+                                           precisionConstant(), m_workspace);
 
-    if (!ptr)
-        return;
+    updateResults(m_faces.data(), count, results);
+}
 
-    const int count = *ptr;
-    const auto records = reinterpret_cast<short*>(ptr + 1);
+// ---------------------------------------------------------------------------------------------- //
+
+void LibFaceDetectionBackend::updateResults(const FaceDetection* faces, int count,
+                                            RectList* results) const
+{
+    results->clear();
 
     for (int i = 0; i < count; ++i)
     {
-        const auto record = records + i*RecordsStride;
-        const auto confidence = record[0];
-
-        if (confidence > MinimumConfidence)
-        {
-            const auto x = static_cast<unsigned int>(record[1]);
-            const auto y = static_cast<unsigned int>(record[2]);
-            const auto w = static_cast<unsigned int>(record[3]);
-            const auto h = static_cast<unsigned int>(record[4]);
-
-            results->emplace_back(x, y, w, h);
-        }
+        const auto x = static_cast<unsigned int>(faces[i].x);
+        const auto y = static_cast<unsigned int>(faces[i].y);
+        const auto w = static_cast<unsigned int>(faces[i].w);
+        const auto h = static_cast<unsigned int>(faces[i].h);
+
+        results->emplace_back(x, y, w, h);
     }
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void LibFaceDetectionBackend::process(std::span<const BgraPixel> image, RectList* results) const
+auto LibFaceDetectionBackend::precisionConstant() const -> int
 {
-    Convert::toBgr(image, m_image);
-    process(m_image, results);
+    if (m_precision == Precision::Int8)
+        return FACEDETECT_PRECISION_INT8;
+
+    if (m_precision == Precision::Float16)
+        return FACEDETECT_PRECISION_FP16;
+
+    return FACEDETECT_PRECISION_FP32;
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -140,3 +204,19 @@ auto LibFaceDetectionBackend::make(unsigned int width,
 }
 
 // ---------------------------------------------------------------------------------------------- //
+
+auto LibFaceDetectionBackend::makeInt8(unsigned int width,
+                                       unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<LibFaceDetectionBackend>(width, height, Precision::Int8);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto LibFaceDetectionBackend::makeFloat16(unsigned int width,
+                                          unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<LibFaceDetectionBackend>(width, height, Precision::Float16);
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -25,20 +25,39 @@
 
 #include "backend.h"
 
+struct FaceDetection;
+struct FaceDetectWorkspace;
+
 IFD_BEGIN_NAMESPACE();
 
 class LibFaceDetectionBackend : public Backend
 {
 public:
     static constexpr const char* Name = "libFaceDetection";
+    static constexpr const char* Int8Name = "libFaceDetection-INT8";
+    static constexpr const char* Float16Name = "libFaceDetection-FP16";
+
+    enum class Precision
+    {
+        Float32,
+        Int8,
+        Float16
+    };
 
 public:
-    LibFaceDetectionBackend(unsigned int width, unsigned int height);
+    LibFaceDetectionBackend(unsigned int width, unsigned int height,
+                            Precision precision = Precision::Float32);
+    ~LibFaceDetectionBackend() override;
 
     auto name() const -> std::string override;
 
     auto preferredImageFormat() const -> ImageFormat override;
 
+    void setFaceSizeRange(unsigned int minimum, unsigned int maximum) override;
+
+    void setProfilingEnabled(bool enabled) override;
+    auto profileReport(ProfileFormat format) const -> std::string override;
+
     void process(std::span<const GrayscalePixel> image, RectList* results) const override;
     void process(std::span<const RgbPixel> image, RectList* results) const override;
     void process(std::span<const RgbaPixel> image, RectList* results) const override;
@@ -46,10 +65,23 @@ public:
     void process(std::span<const BgraPixel> image, RectList* results) const override;
 
     static auto make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeInt8(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeFloat16(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
 
 private:
-    mutable std::vector<unsigned char> m_buffer;
-    mutable std::vector<BgrPixel> m_image;
+    // The network reads all pixel formats directly, format is one of FACEDETECT_FORMAT_*
+    template <typename T>
+    void processImage(std::span<const T> image, int format, RectList* results) const;
+
+    void updateResults(const FaceDetection* faces, int count, RectList* results) const;
+
+    auto precisionConstant() const -> int;
+
+private:
+    Precision m_precision;
+    FaceDetectWorkspace* m_workspace;
+
+    mutable std::vector<FaceDetection> m_faces;
 };
 
 IFD_END_NAMESPACE();
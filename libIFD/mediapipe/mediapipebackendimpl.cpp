@@ -28,6 +28,15 @@
 #include "mediapipe/framework/formats/image_frame.h"
 #include "mediapipe/framework/port/parse_text_proto.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #ifndef MEDIAPIPE_DISABLE_GPU
 #include "mediapipe/gpu/gl_calculator_helper.h"
 #include "mediapipe/gpu/gpu_buffer.h"
@@ -45,53 +54,59 @@ namespace {
     constexpr const char* PresenceStream = "face_presence";
     constexpr const char* DetectionStream = "face_detections";
 
-    constexpr const char* GraphText = R"(
-        input_stream: "input_video"
+    // The graph's errors are only visible through HasError(), waits check it this often
+    constexpr auto ErrorCheckInterval = std::chrono::milliseconds(100);
+
+    // Generates the graph for the settings, the face detection subgraph takes the inference
+    // options as FaceDetectionOptions
+    auto graphText(const MediaPipeBackendImpl::Settings& settings) -> std::string
+    {
+        using Model = MediaPipeBackendImpl::Model;
+
+        std::string text = R"(
+            input_stream: "input_video"
 
-        output_stream: "face_detections"
-        output_stream: "face_presence"
+            output_stream: "face_detections"
+            output_stream: "face_presence"
+        )";
+
+        if (settings.threads > 0)
+            text += "num_threads: " + std::to_string(settings.threads) + "\n";
+
+        const std::string model = settings.model == Model::ShortRange ? "ShortRange" : "FullRange";
 
-        node {
-    )"
 #ifdef MEDIAPIPE_DISABLE_GPU
-    R"(
-            calculator: "FaceDetectionFullRangeCpu"
-    )"
+        text += "node { calculator: \"FaceDetection" + model + "Cpu\"\n";
 #else
-    R"(
-            calculator: "FaceDetectionFullRangeGpu"
-    )"
+        text += "node { calculator: \"FaceDetection" + model + "Gpu\"\n";
 #endif
-    R"(
-            input_stream: "IMAGE:input_video"
-            output_stream: "DETECTIONS:face_detections"
-        }
+        text += R"(
+                input_stream: "IMAGE:input_video"
+                output_stream: "DETECTIONS:face_detections"
+        )";
 
-        node {
-            calculator: "PacketPresenceCalculator"
-            input_stream: "PACKET:face_detections"
-            output_stream: "PRESENCE:face_presence"
+#ifdef MEDIAPIPE_DISABLE_GPU
+        if (settings.inferenceThreads > 0)
+        {
+            text += "node_options: { [type.googleapis.com/mediapipe.FaceDetectionOptions] { "
+                    "delegate: { xnnpack { num_threads: "
+                  + std::to_string(settings.inferenceThreads) + " } } } }\n";
         }
-    )";
-}
-
-// ---------------------------------------------------------------------------------------------- //
-
-class MediaPipeBackendImpl::Private
-{
-public:
-    mediapipe::CalculatorGraph graph;
-
-#ifndef MEDIAPIPE_DISABLE_GPU
-    mediapipe::GlCalculatorHelper gpuHelper;
 #endif
 
-    mediapipe::StatusOrPoller presencePoller;
-    mediapipe::StatusOrPoller detectionPoller;
+        text += R"(
+            }
 
-    mediapipe::Packet presencePacket;
-    mediapipe::Packet detectionPacket;
-};
+            node {
+                calculator: "PacketPresenceCalculator"
+                input_stream: "PACKET:face_detections"
+                output_stream: "PRESENCE:face_presence"
+            }
+        )";
+
+        return text;
+    }
+}
 
 // ---------------------------------------------------------------------------------------------- //
 
@@ -110,17 +125,125 @@ auto toString(const absl::StatusOr<T>& status) -> std::string
 
 // ---------------------------------------------------------------------------------------------- //
 
-MediaPipeBackendImpl::MediaPipeBackendImpl(unsigned int width, unsigned int height)
-    : d(std::make_unique<Private>()),
-      m_width(width),
-      m_height(height)
+namespace {
+    // A started graph, shared by all backends with the same settings. The detection subgraph
+    // scales its input to the model size, so frames of any size can be mixed.
+    class SharedGraph
+    {
+    public:
+        // A frame whose results have not been delivered yet
+        struct Frame
+        {
+            mediapipe::Timestamp timestamp;
+
+            const void* client; // The backend that added the frame
+            uint64_t id;
+
+            unsigned int width;
+            unsigned int height;
+
+            RectList* results; // Set for frames passed to process(), which waits for done
+            bool* done;
+            std::shared_ptr<const ResultCallback> callback; // Set for streamed frames
+
+            bool presenceKnown = false;
+            bool present = false;
+            bool detectionsKnown = false;
+            RectList faces;
+        };
+
+    public:
+        explicit SharedGraph(const MediaPipeBackendImpl::Settings& settings);
+        ~SharedGraph();
+
+        // Blocks while the client has the maximum number of frames in flight, frames passed to
+        // process() don't count. The owner is released once the graph no longer needs the data.
+        void addFrame(const uint8_t* data, unsigned int channelCount, Frame frame,
+                      unsigned int maxInFlightFrames, std::shared_ptr<const void> owner);
+
+        // Throws if the graph fails before the frame is done
+        void waitUntilDone(const bool* done);
+
+        // Until all frames of the client were delivered. Result callbacks don't wait, the graph
+        // may need their thread to finish the frames.
+        void waitForFrames(const void* client);
+
+        auto hasFailed() const -> bool;
+
+    private:
+        auto findFrame(const mediapipe::Timestamp& timestamp) -> Frame*;
+        auto frameCount(const void* client) const -> size_t;
+        auto pendingCount(const void* client) const -> size_t;
+
+        void deliverFrames(std::unique_lock<std::mutex>& lock);
+
+        template <typename Predicate>
+        void wait(std::unique_lock<std::mutex>& lock, Predicate predicate);
+
+    private:
+        mediapipe::CalculatorGraph graph;
+
+#ifndef MEDIAPIPE_DISABLE_GPU
+        mediapipe::GlCalculatorHelper gpuHelper;
+#endif
+
+        // Packets must be added in timestamp order, even by different clients
+        std::mutex inputMutex;
+
+        // The observers are called on the graph's threads
+        std::mutex mutex;
+        std::condition_variable condition;
+
+        std::deque<Frame> frames; // In timestamp order
+        int64_t nextTimestamp = 0;
+
+        bool failed = false; // Set once a wait saw the graph's error, its frames are dropped
+
+        std::vector<const void*> addingClients; // Waiting for the input mutex, count as in flight
+
+        // Complete streamed frames, passed to their callbacks by one thread at a time
+        std::deque<Frame> completed;
+        std::thread::id deliveringThread;
+        const void* deliveringClient = nullptr;
+    };
+
+    // Graphs are started once per configuration and kept running while a backend uses them, so
+    // recreating a backend, e.g. for another resolution, doesn't load the model again as long as
+    // another one exists. The last backend stops the graph.
+    std::mutex graphMutex;
+    std::map<MediaPipeBackendImpl::Settings, std::weak_ptr<SharedGraph>> graphs;
+
+    auto getGraph(const MediaPipeBackendImpl::Settings& settings) -> std::shared_ptr<SharedGraph>
+    {
+        std::lock_guard lock(graphMutex);
+
+        std::erase_if(graphs, [](const auto& entry) {
+            return entry.second.expired();
+        });
+
+        std::shared_ptr<SharedGraph> graph = graphs[settings].lock();
+
+        // A failed graph stays with the backends using it, new ones get a new graph
+        if (!graph || graph->hasFailed())
+        {
+            graph = std::make_shared<SharedGraph>(settings);
+            graphs[settings] = graph;
+        }
+
+        return graph;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+SharedGraph::SharedGraph(const MediaPipeBackendImpl::Settings& settings)
 {
     mediapipe::CalculatorGraphConfig config;
 
-    if (!mediapipe::ParseTextProto(GraphText, &config))
+    if (!mediapipe::ParseTextProto(graphText(settings), &config))
         throw Error("Unable to parse graph text.");
 
-    absl::Status initialized = d->graph.Initialize(config);
+    absl::Status initialized = graph.Initialize(config);
 
     if (!initialized.ok())
         throw Error("Unable to initialize graph: " + toString(initialized));
@@ -131,25 +254,72 @@ MediaPipeBackendImpl::MediaPipeBackendImpl(unsigned int width, unsigned int heig
     if (!resources.ok())
         throw Error("Unable to create GPU resources: " + toString(resources));
 
-    absl::Status resourcesSet = d->graph.SetGpuResources(std::move(*resources));
+    absl::Status resourcesSet = graph.SetGpuResources(std::move(*resources));
 
     if (!resourcesSet.ok())
         throw Error("Unable to set GPU resources: " + toString(resourcesSet));
 
-    d->gpuHelper.InitializeForTest(d->graph.GetGpuResources().get());
+    gpuHelper.InitializeForTest(graph.GetGpuResources().get());
 #endif
 
-    d->presencePoller = d->graph.AddOutputStreamPoller(PresenceStream);
+    static const auto toUint = [](auto value) {
+        return static_cast<unsigned int>(std::round(value));
+    };
+
+    const auto observePresence = [this](const mediapipe::Packet& packet) -> absl::Status
+    {
+        std::unique_lock lock(mutex);
+        Frame* frame = findFrame(packet.Timestamp());
+
+        if (frame)
+        {
+            frame->presenceKnown = true;
+            frame->present = packet.Get<bool>();
+            deliverFrames(lock);
+        }
+
+        return absl::OkStatus();
+    };
+
+    const auto observeDetections = [this](const mediapipe::Packet& packet) -> absl::Status
+    {
+        std::unique_lock lock(mutex);
+        Frame* frame = findFrame(packet.Timestamp());
+
+        if (!frame)
+            return absl::OkStatus();
+
+        const auto& output = packet.Get<std::vector<mediapipe::Detection>>();
+
+        for (const auto& detection : output)
+        {
+            const auto& box = detection.location_data().relative_bounding_box();
+
+            const auto x = toUint(frame->width  * box.xmin());
+            const auto y = toUint(frame->height * box.ymin());
+            const auto w = toUint(frame->width  * box.width());
+            const auto h = toUint(frame->height * box.height());
+
+            frame->faces.push_back({ x, y, w, h });
+        }
+
+        frame->detectionsKnown = true;
+        deliverFrames(lock);
+
+        return absl::OkStatus();
+    };
+
+    absl::Status observed = graph.ObserveOutputStream(PresenceStream, observePresence);
 
-    if (!d->presencePoller.ok())
-        throw Error("Unable to add output-stream poller: " + toString(d->presencePoller));
+    if (!observed.ok())
+        throw Error("Unable to observe output stream: " + toString(observed));
 
-    d->detectionPoller = d->graph.AddOutputStreamPoller(DetectionStream);
+    observed = graph.ObserveOutputStream(DetectionStream, observeDetections);
 
-    if (!d->detectionPoller.ok())
-        throw Error("Unable to add output-stream poller: " + toString(d->detectionPoller));
+    if (!observed.ok())
+        throw Error("Unable to observe output stream: " + toString(observed));
 
-    absl::Status started = d->graph.StartRun({});
+    absl::Status started = graph.StartRun({});
 
     if (!started.ok())
         throw Error("Unable to start graph: " + toString(started));
@@ -157,80 +327,341 @@ MediaPipeBackendImpl::MediaPipeBackendImpl(unsigned int width, unsigned int heig
 
 // ---------------------------------------------------------------------------------------------- //
 
-MediaPipeBackendImpl::~MediaPipeBackendImpl()
+SharedGraph::~SharedGraph()
 {
-    d->graph.CloseInputStream(InputStream);
-    d->graph.WaitUntilDone();
+    graph.CloseInputStream(InputStream);
+    graph.WaitUntilDone();
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
-void MediaPipeBackendImpl::process(std::span<const RgbaPixel> image, RectList* results) const
+// The face detection subgraph accepts both SRGB and SRGBA frames
+void SharedGraph::addFrame(const uint8_t* data, unsigned int channelCount, Frame frame,
+                           unsigned int maxInFlightFrames, std::shared_ptr<const void> owner)
 {
-    static constexpr auto ImageFormat = mediapipe::ImageFormat::SRGBA;
-    static constexpr size_t ChannelCount = 4;
+    const auto imageFormat = channelCount == 3 ? mediapipe::ImageFormat::SRGB
+                                               : mediapipe::ImageFormat::SRGBA;
 
-    static const auto deleter = [](uint8_t*) {}; // Don't allow image frame to delete data
+    // The image frame must not delete the data, only release its owner
+    const auto deleter = [owner = std::move(owner)](uint8_t*) {};
 
-    static const auto toUint = [](auto value) {
-        return static_cast<unsigned int>(std::round(value));
-    };
+    const auto stepWidth = static_cast<int>(frame.width * channelCount);
+    auto ptr = const_cast<uint8_t*>(data);
+
+    auto imageFrame = std::make_unique<mediapipe::ImageFrame>(imageFormat, frame.width,
+                                                              frame.height, stepWidth, ptr,
+                                                              deleter);
+    // The input mutex is only taken once the frame may be added, other clients and the result
+    // callbacks must not wait for this client's frames
+    {
+        std::unique_lock lock(mutex);
+
+        // Frames submitted from a result callback can't wait for the graph either
+        wait(lock, [&] {
+            return failed || frame.done || deliveringThread == std::this_thread::get_id()
+                || frameCount(frame.client) < maxInFlightFrames;
+        });
 
-    const size_t stepWidth = m_width * ChannelCount;
-    auto ptr = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(image.data()));
+        if (failed)
+            throw Error("Unable to add packet to input stream: The graph has failed.");
 
-    auto frame = std::make_unique<mediapipe::ImageFrame>(ImageFormat, m_width, m_height,
-                                                         stepWidth, ptr, deleter);
-    const mediapipe::Timestamp timestamp(m_timestamp++);
+        addingClients.push_back(frame.client);
+    }
+
+    std::lock_guard inputLock(inputMutex);
+    mediapipe::Timestamp timestamp;
+
+    {
+        std::lock_guard lock(mutex);
+        addingClients.erase(std::find(addingClients.begin(), addingClients.end(), frame.client));
+
+        timestamp = mediapipe::Timestamp(nextTimestamp++);
+        frame.timestamp = timestamp;
+
+        frames.push_back(std::move(frame));
+    }
 
 #ifdef MEDIAPIPE_DISABLE_GPU
-    auto packet = mediapipe::Adopt(frame.release());
-    absl::Status added = d->graph.AddPacketToInputStream(InputStream, packet.At(timestamp));
+    auto packet = mediapipe::Adopt(imageFrame.release());
+    absl::Status added = graph.AddPacketToInputStream(InputStream, packet.At(timestamp));
 #else
     const auto addPacket = [&]() -> absl::Status
     {
-        auto buffer = d->gpuHelper.GpuBufferCopyingImageFrame(*frame.get());
-        auto texture = d->gpuHelper.CreateSourceTexture(buffer);
+        auto buffer = gpuHelper.GpuBufferCopyingImageFrame(*imageFrame.get());
+        auto texture = gpuHelper.CreateSourceTexture(buffer);
 
         auto gpuFrame = texture.GetFrame<mediapipe::GpuBuffer>();
         texture.Release();
 
         auto packet = mediapipe::Adopt(gpuFrame.release());
-        return d->graph.AddPacketToInputStream(InputStream, packet.At(timestamp));
+        return graph.AddPacketToInputStream(InputStream, packet.At(timestamp));
     };
 
-    absl::Status added = d->gpuHelper.RunInGlContext(addPacket);
+    absl::Status added = gpuHelper.RunInGlContext(addPacket);
 #endif
 
     if (!added.ok())
+    {
+        std::lock_guard lock(mutex);
+
+        // The frame is the last one, nothing can arrive for it
+        frames.pop_back();
         throw Error("Unable to add packet to input stream: " + toString(added));
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void SharedGraph::waitUntilDone(const bool* done)
+{
+    std::unique_lock lock(mutex);
+    wait(lock, [&] { return failed || *done; });
+
+    if (*done)
+        return;
+
+    // The frame may have been added after the others were dropped
+    std::erase_if(frames, [&](const Frame& frame) {
+        return frame.done == done;
+    });
+
+    throw Error("Unable to poll for presence of next detection packet.");
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void SharedGraph::waitForFrames(const void* client)
+{
+    std::unique_lock lock(mutex);
+
+    if (deliveringThread != std::this_thread::get_id())
+        wait(lock, [&] { return pendingCount(client) == 0; });
+}
 
-    if (!d->presencePoller->Next(&d->presencePacket))
-        throw Error("Unable to poll for presence of next detection packet.");
+// ---------------------------------------------------------------------------------------------- //
 
-    const auto present = d->presencePacket.Get<bool>();
+auto SharedGraph::hasFailed() const -> bool
+{
+    return graph.HasError();
+}
 
-    results->clear();
+// ---------------------------------------------------------------------------------------------- //
 
-    if (present)
+auto SharedGraph::findFrame(const mediapipe::Timestamp& timestamp) -> Frame*
+{
+    for (auto& frame : frames)
     {
-        if (!d->detectionPoller->Next(&d->detectionPacket))
-            throw Error("Unable to poll for next detection packet.");
+        if (frame.timestamp == timestamp)
+            return &frame;
+    }
 
-        const auto& output = d->detectionPacket.Get<std::vector<mediapipe::Detection>>();
+    return nullptr;
+}
 
-        for (const auto& detection : output)
+// ---------------------------------------------------------------------------------------------- //
+
+auto SharedGraph::frameCount(const void* client) const -> size_t
+{
+    const auto count = std::count_if(frames.begin(), frames.end(), [&](const Frame& frame) {
+        return frame.client == client;
+    });
+
+    return count + std::count(addingClients.begin(), addingClients.end(), client);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Including the complete frames whose callback has not returned yet
+auto SharedGraph::pendingCount(const void* client) const -> size_t
+{
+    const auto completedCount = std::count_if(completed.begin(), completed.end(),
+                                              [&](const Frame& frame) {
+        return frame.client == client;
+    });
+
+    return frameCount(client) + completedCount + (deliveringClient == client ? 1 : 0);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The presence and detection streams are observed independently, so frames are only complete
+// once both have been seen. The callbacks are called without the mutex, so they may submit
+// frames or stop streaming, and by one thread at a time, which keeps the frames in order.
+void SharedGraph::deliverFrames(std::unique_lock<std::mutex>& lock)
+{
+    while (!frames.empty())
+    {
+        Frame& frame = frames.front();
+
+        if (!frame.presenceKnown || (frame.present && !frame.detectionsKnown))
+            break;
+
+        if (frame.done)
         {
-            const auto& box = detection.location_data().relative_bounding_box();
+            *frame.results = std::move(frame.faces);
+            *frame.done = true;
+        }
+        else if (frame.callback && *frame.callback)
+        {
+            completed.push_back(std::move(frame));
+        }
+
+        frames.pop_front();
+    }
+
+    condition.notify_all();
+
+    // Frames completed meanwhile are picked up by the thread that is already delivering
+    if (deliveringThread != std::thread::id())
+        return;
+
+    deliveringThread = std::this_thread::get_id();
+
+    while (!completed.empty())
+    {
+        const Frame frame = std::move(completed.front());
+        completed.pop_front();
+
+        deliveringClient = frame.client;
+        lock.unlock();
+
+        (*frame.callback)(frame.id, frame.faces);
+
+        lock.lock();
+        deliveringClient = nullptr;
+
+        condition.notify_all();
+    }
 
-            const auto x = toUint(m_width  * box.xmin());
-            const auto y = toUint(m_height * box.ymin());
-            const auto w = toUint(m_width  * box.width());
-            const auto h = toUint(m_height * box.height());
+    deliveringThread = std::thread::id();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The observers aren't called for frames anymore once the graph has failed, so they are dropped
+// and the waiting threads woken up. Complete frames are still delivered.
+template <typename Predicate>
+void SharedGraph::wait(std::unique_lock<std::mutex>& lock, Predicate predicate)
+{
+    while (!condition.wait_for(lock, ErrorCheckInterval, predicate))
+    {
+        if (!failed && graph.HasError())
+        {
+            failed = true;
+            frames.clear();
 
-            results->push_back({ x, y, w, h });
+            condition.notify_all();
         }
     }
 }
 
 // ---------------------------------------------------------------------------------------------- //
+
+class MediaPipeBackendImpl::Private
+{
+public:
+    std::shared_ptr<SharedGraph> graph;
+
+    // Frames keep the callback they were submitted with, it may be replaced while they're in
+    // flight when streaming is stopped from a callback
+    std::shared_ptr<const ResultCallback> callback;
+    unsigned int maxInFlightFrames = 1;
+};
+
+// ---------------------------------------------------------------------------------------------- //
+
+MediaPipeBackendImpl::MediaPipeBackendImpl(unsigned int width, unsigned int height,
+                                           const Settings& settings)
+    : d(std::make_unique<Private>()),
+      m_width(width),
+      m_height(height)
+{
+    d->graph = getGraph(settings);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The graph keeps running for the other backends, if any
+MediaPipeBackendImpl::~MediaPipeBackendImpl()
+{
+    d->graph->waitForFrames(d.get());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::process(std::span<const RgbPixel> image, RectList* results) const
+{
+    processFrame(reinterpret_cast<const uint8_t*>(image.data()), 3, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::process(std::span<const RgbaPixel> image, RectList* results) const
+{
+    processFrame(reinterpret_cast<const uint8_t*>(image.data()), 4, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::processFrame(const uint8_t* data, unsigned int channelCount,
+                                        RectList* results) const
+{
+    bool done = false;
+    addFrame(data, channelCount, 0, nullptr, results, &done);
+
+    d->graph->waitUntilDone(&done);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::startStreaming(ResultCallback callback, unsigned int maxInFlightFrames)
+{
+    d->graph->waitForFrames(d.get());
+
+    d->callback = std::make_shared<const ResultCallback>(std::move(callback));
+    d->maxInFlightFrames = maxInFlightFrames;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::stopStreaming()
+{
+    d->graph->waitForFrames(d.get());
+
+    d->callback = nullptr;
+    d->maxInFlightFrames = 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::submit(std::span<const RgbPixel> image, uint64_t frame,
+                                  std::shared_ptr<const void> owner) const
+{
+    const auto data = reinterpret_cast<const uint8_t*>(image.data());
+    addFrame(data, 3, frame, std::move(owner), nullptr, nullptr);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::submit(std::span<const RgbaPixel> image, uint64_t frame,
+                                  std::shared_ptr<const void> owner) const
+{
+    const auto data = reinterpret_cast<const uint8_t*>(image.data());
+    addFrame(data, 4, frame, std::move(owner), nullptr, nullptr);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackendImpl::addFrame(const uint8_t* data, unsigned int channelCount,
+                                    uint64_t frame, std::shared_ptr<const void> owner,
+                                    RectList* results, bool* done) const
+{
+    SharedGraph::Frame graphFrame = {
+        {}, d.get(), frame, m_width, m_height, results, done, d->callback
+    };
+
+    d->graph->addFrame(data, channelCount, std::move(graphFrame), d->maxInFlightFrames,
+                       std::move(owner));
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -25,24 +25,59 @@
 
 #include "ifd.h"
 
+#include <compare>
+
 namespace ifd {
 
 class MediaPipeBackendImpl
 {
 public:
-    MediaPipeBackendImpl(unsigned int width, unsigned int height);
+    enum class Model
+    {
+        FullRange,
+        ShortRange // For faces within about two metres, with a 128x128 input
+    };
+
+    // Thread counts of 0 keep MediaPipe's defaults
+    struct Settings
+    {
+        Model model;
+        unsigned int threads;
+        unsigned int inferenceThreads;
+
+        auto operator<=>(const Settings&) const = default; // Graphs are shared per settings
+    };
+
+public:
+    MediaPipeBackendImpl(unsigned int width, unsigned int height, const Settings& settings);
     ~MediaPipeBackendImpl();
 
+    // The image data is wrapped without copying, as SRGB or SRGBA
+    void process(std::span<const RgbPixel> image, RectList* results) const;
     void process(std::span<const RgbaPixel> image, RectList* results) const;
 
+    // Results are delivered by the output-stream observers. The owner, if any, is released once
+    // the graph no longer needs the image data.
+    void startStreaming(ResultCallback callback, unsigned int maxInFlightFrames);
+    void stopStreaming();
+
+    void submit(std::span<const RgbPixel> image, uint64_t frame,
+                std::shared_ptr<const void> owner = nullptr) const;
+    void submit(std::span<const RgbaPixel> image, uint64_t frame,
+                std::shared_ptr<const void> owner = nullptr) const;
+
+private:
+    void processFrame(const uint8_t* data, unsigned int channelCount, RectList* results) const;
+
+    void addFrame(const uint8_t* data, unsigned int channelCount, uint64_t frame,
+                  std::shared_ptr<const void> owner, RectList* results, bool* done) const;
+
 private:
     class Private;
     std::unique_ptr<Private> d;
 
     const unsigned int m_width;
     const unsigned int m_height;
-
-    mutable size_t m_timestamp = 0;
 };
 
 } // End of namespace ifd
@@ -30,17 +30,21 @@ using namespace ifd;
 
 // ---------------------------------------------------------------------------------------------- //
 
-MediaPipeBackend::MediaPipeBackend(unsigned int width, unsigned int height)
+MediaPipeBackend::MediaPipeBackend(unsigned int width, unsigned int height, Model model)
     : Backend(width, height),
-      m_impl(width, height),
-      m_rgbaImage(width * height)
+      m_model(model),
+      m_rgbImage(width * height)
 {
+    m_impl = createImpl(threadCount(), inferenceThreadCount());
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 auto MediaPipeBackend::name() const -> std::string
 {
+    if (m_model == Model::ShortRange)
+        return ShortRangeName;
+
     return Name;
 }
 
@@ -53,41 +57,138 @@ auto MediaPipeBackend::preferredImageFormat() const -> ImageFormat
 
 // ---------------------------------------------------------------------------------------------- //
 
+void MediaPipeBackend::setThreadCount(unsigned int threads, unsigned int inferenceThreads)
+{
+    // The backend keeps its graph if the one for the new settings can't be started. The
+    // remaining frames are delivered before the new graph is used.
+    m_impl = createImpl(threads, inferenceThreads);
+    Backend::setThreadCount(threads, inferenceThreads);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
 void MediaPipeBackend::process(std::span<const GrayscalePixel> image, RectList* results) const
 {
-    Convert::toRgba(image, m_rgbaImage);
-    process(m_rgbaImage, results);
+    Convert::toRgb(image, m_rgbImage);
+    process(m_rgbImage, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void MediaPipeBackend::process(std::span<const RgbPixel> image, RectList* results) const
 {
-    Convert::toRgba(image, m_rgbaImage);
-    process(m_rgbaImage, results);
+    m_impl->process(image, results);
+    filterFaceSizes(results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void MediaPipeBackend::process(std::span<const RgbaPixel> image, RectList* results) const
 {
-    m_impl.process(image, results);
+    m_impl->process(image, results);
+    filterFaceSizes(results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void MediaPipeBackend::process(std::span<const BgrPixel> image, RectList* results) const
 {
-    Convert::toRgba(image, m_rgbaImage);
-    process(m_rgbaImage, results);
+    Convert::toRgb(image, m_rgbImage);
+    process(m_rgbImage, results);
 }
 
 // ---------------------------------------------------------------------------------------------- //
 
 void MediaPipeBackend::process(std::span<const BgraPixel> image, RectList* results) const
 {
-    Convert::toRgba(image, m_rgbaImage);
-    process(m_rgbaImage, results);
+    Convert::toRgb(image, m_rgbImage);
+    process(m_rgbImage, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::startStreaming(ResultCallback callback, unsigned int maxInFlightFrames)
+{
+    Backend::startStreaming(callback, maxInFlightFrames);
+
+    m_streamingCallback = [this, callback](uint64_t frame, const RectList& results) {
+        RectList faces = results;
+        filterFaceSizes(&faces);
+        callback(frame, faces);
+    };
+
+    m_maxInFlightFrames = maxInFlightFrames;
+    m_impl->startStreaming(m_streamingCallback, maxInFlightFrames);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::stopStreaming()
+{
+    m_impl->stopStreaming();
+    Backend::stopStreaming();
+
+    m_streamingCallback = nullptr;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::submit(std::span<const GrayscalePixel> image, uint64_t frame) const
+{
+    submitConverted(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::submit(std::span<const RgbPixel> image, uint64_t frame) const
+{
+    m_impl->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::submit(std::span<const RgbaPixel> image, uint64_t frame) const
+{
+    m_impl->submit(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::submit(std::span<const BgrPixel> image, uint64_t frame) const
+{
+    submitConverted(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void MediaPipeBackend::submit(std::span<const BgraPixel> image, uint64_t frame) const
+{
+    submitConverted(image, frame);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+template <typename T>
+void MediaPipeBackend::submitConverted(std::span<const T> image, uint64_t frame) const
+{
+    auto buffer = std::make_shared<std::vector<RgbPixel>>(width() * height());
+
+    Convert::toRgb(image, *buffer);
+    m_impl->submit(std::span<const RgbPixel>(*buffer), frame, buffer);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto MediaPipeBackend::createImpl(unsigned int threads, unsigned int inferenceThreads) const
+    -> std::unique_ptr<MediaPipeBackendImpl>
+{
+    const MediaPipeBackendImpl::Settings settings = { m_model, threads, inferenceThreads };
+    auto impl = std::make_unique<MediaPipeBackendImpl>(width(), height(), settings);
+
+    if (isStreaming())
+        impl->startStreaming(m_streamingCallback, m_maxInFlightFrames);
+
+    return impl;
 }
 
 // ---------------------------------------------------------------------------------------------- //
@@ -98,3 +199,11 @@ auto MediaPipeBackend::make(unsigned int width, unsigned int height) -> std::uni
 }
 
 // ---------------------------------------------------------------------------------------------- //
+
+auto MediaPipeBackend::makeShortRange(unsigned int width,
+                                      unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<MediaPipeBackend>(width, height, Model::ShortRange);
+}
+
+// ---------------------------------------------------------------------------------------------- //
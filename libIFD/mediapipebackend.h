@@ -32,25 +32,57 @@ class MediaPipeBackend : public Backend
 {
 public:
     static constexpr const char* Name = "MediaPipe";
+    static constexpr const char* ShortRangeName = "MediaPipe-ShortRange";
+
+    using Model = MediaPipeBackendImpl::Model;
 
 public:
-    MediaPipeBackend(unsigned int width, unsigned int height);
+    MediaPipeBackend(unsigned int width, unsigned int height, Model model = Model::FullRange);
 
     auto name() const -> std::string override;
 
     auto preferredImageFormat() const -> ImageFormat override;
 
+    // Restarts the graph with the new thread counts
+    void setThreadCount(unsigned int threads, unsigned int inferenceThreads) override;
+
     void process(std::span<const GrayscalePixel> image, RectList* results) const override;
     void process(std::span<const RgbPixel> image, RectList* results) const override;
     void process(std::span<const RgbaPixel> image, RectList* results) const override;
     void process(std::span<const BgrPixel> image, RectList* results) const override;
     void process(std::span<const BgraPixel> image, RectList* results) const override;
 
+    void startStreaming(ResultCallback callback, unsigned int maxInFlightFrames) override;
+    void stopStreaming() override;
+
+    void submit(std::span<const GrayscalePixel> image, uint64_t frame) const override;
+    void submit(std::span<const RgbPixel> image, uint64_t frame) const override;
+    void submit(std::span<const RgbaPixel> image, uint64_t frame) const override;
+    void submit(std::span<const BgrPixel> image, uint64_t frame) const override;
+    void submit(std::span<const BgraPixel> image, uint64_t frame) const override;
+
     static auto make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeShortRange(unsigned int width,
+                               unsigned int height) -> std::unique_ptr<Backend>;
 
 private:
-    MediaPipeBackendImpl m_impl;
-    mutable std::vector<RgbaPixel> m_rgbaImage;
+    auto createImpl(unsigned int threads, unsigned int inferenceThreads) const
+        -> std::unique_ptr<MediaPipeBackendImpl>;
+
+    // Streamed frames may still be in the graph when the next one arrives, so each converted
+    // frame gets its own buffer
+    template <typename T>
+    void submitConverted(std::span<const T> image, uint64_t frame) const;
+
+private:
+    Model m_model;
+    std::unique_ptr<MediaPipeBackendImpl> m_impl;
+    ResultCallback m_streamingCallback; // With the face sizes filtered
+    unsigned int m_maxInFlightFrames = 1;
+
+    // RGB and RGBA images are passed to the graph as they are, the other formats are converted
+    // to RGB in a single pass
+    mutable std::vector<RgbPixel> m_rgbImage;
 };
 
 IFD_END_NAMESPACE();
@@ -4,34 +4,60 @@ import os
 import re
 import sys
 
-if len(sys.argv) != 4:
-    print("Usage: %s infile outfile strname" % sys.argv[0])
+if len(sys.argv) < 4 or len(sys.argv) % 2 != 0:
+    print("Usage: %s outfile infile strname [infile strname ...]" % sys.argv[0])
     sys.exit(2)
-    
-if os.path.isfile(sys.argv[2]) and os.path.getmtime(sys.argv[2]) >= os.path.getmtime(sys.argv[1]):
-    print("OpenCV model header is up to date.")
-    sys.exit(0)
 
-infile = open(sys.argv[1], 'r')
-data = infile.read()
-infile.close()
+outname = sys.argv[1]
+models = list(zip(sys.argv[2::2], sys.argv[3::2]))
 
-outfile = open(sys.argv[2], 'w')
+# The header also has to be regenerated when the list of models changes
+comment = "// Models: %s\n" % " ".join(name for _, name in models)
+
+if os.path.isfile(outname) and all(os.path.getmtime(outname) >= os.path.getmtime(infile)
+                                   for infile, _ in models):
+    with open(outname, 'r') as header:
+        if comment in header.read():
+            print("OpenCV model header is up to date.")
+            sys.exit(0)
+
+outfile = open(outname, 'w')
 
 outfile.write("// Automatically generated by makeheader.py. Do not edit, it will be overwritten!\n")
+outfile.write(comment)
 outfile.write("#pragma once\n")
 outfile.write("\n")
 outfile.write("#include <string>\n")
-outfile.write("\n")
-outfile.write("const std::string %s = \n" % sys.argv[3])
 
-lines = data.splitlines()
+for infile, strname in models:
+    outfile.write("\n")
+
+    # Cascades are XML, other models (e.g. ONNX networks) are embedded as bytes
+    if not infile.endswith(".xml"):
+        with open(infile, 'rb') as model:
+            data = model.read()
+
+        outfile.write("const unsigned char %s[] = {\n" % strname)
+
+        for i in range(0, len(data), 16):
+            outfile.write("    %s,\n" % ", ".join("0x%02x" % byte for byte in data[i:i + 16]))
+
+        outfile.write("};\n")
+        continue
+
+    with open(infile, 'r') as model:
+        data = model.read()
+
+    outfile.write("const std::string %s = \n" % strname)
+
+    lines = data.splitlines()
+
+    for line in lines:
+        line = line.replace('\"', '\\\"')
+        outfile.write("    \"%s\"\n" % line)
 
-for line in lines:
-    line = line.replace('\"', '\\\"')
-    outfile.write("    \"%s\"\n" % line)
+    outfile.write(";\n")
 
-outfile.write(";\n")
 outfile.close()
 
 print("New OpenCV model header generated.")
@@ -33,9 +33,16 @@ class OpenCVBackend : public Backend
 {
 public:
     static constexpr const char* Name = "OpenCV";
+    static constexpr const char* LbpName = "OpenCV-LBP";
+
+    enum class Model
+    {
+        Haar,
+        Lbp // Only built into corpusbenchmark (IFD_USE_OPENCV_LBP) until compared with Haar
+    };
 
 public:
-    OpenCVBackend(unsigned int width, unsigned int height);
+    OpenCVBackend(unsigned int width, unsigned int height, Model model = Model::Haar);
 
     auto name() const -> std::string override;
 
@@ -48,11 +55,14 @@ public:
     void process(std::span<const BgraPixel> image, RectList* results) const override;
 
     static auto make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
+    static auto makeLbp(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>;
 
 private:
     void updateResults(RectList* results) const;
 
 private:
+    Model m_model;
+
     mutable cv::CascadeClassifier m_classifier;
     mutable cv::Mat m_cvImage;
     mutable std::vector<cv::Rect> m_rects;
@@ -0,0 +1,211 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "../libfacedetectionbackend.h"
+#include "../opencvbackend.h"
+#include "../yunetbackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 5;
+    constexpr double MinimumOverlap = 0.5;
+
+    struct Image
+    {
+        std::string fileName;
+        unsigned int width = 0;
+        unsigned int height = 0;
+        std::vector<RgbPixel> pixels;
+        RectList faces; // Ground truth, may be empty
+    };
+
+    using Factory = auto (*)(unsigned int, unsigned int) -> std::unique_ptr<Backend>;
+
+    const Factory Factories[] = {
+        OpenCVBackend::make,
+        OpenCVBackend::makeLbp,
+        YuNetBackend::make,
+        LibFaceDetectionBackend::make
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->fileName = fileName;
+    image->pixels.resize(size_t(image->width) * image->height);
+    file.read(reinterpret_cast<char*>(image->pixels.data()), image->pixels.size() * 3);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The ground truth is read from <image>.txt if it exists, one face per line as "x y width height"
+static void loadFaces(Image* image)
+{
+    std::ifstream file(image->fileName + ".txt");
+    Rect face = {};
+
+    while (file >> face.x >> face.y >> face.width >> face.height)
+        image->faces.push_back(face);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto overlap(const Rect& a, const Rect& b) -> double
+{
+    const double left = std::max(a.x, b.x);
+    const double top = std::max(a.y, b.y);
+    const double right = std::min(a.x + a.width, b.x + b.width);
+    const double bottom = std::min(a.y + a.height, b.y + b.height);
+
+    if (right <= left || bottom <= top)
+        return 0.0;
+
+    const double intersection = (right - left) * (bottom - top);
+    const double area = double(a.width) * a.height + double(b.width) * b.height;
+
+    return intersection / (area - intersection);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Each ground truth face matches at most one detection
+static auto countMatches(const RectList& faces, const RectList& detections) -> size_t
+{
+    std::vector<bool> used(detections.size(), false);
+    size_t matches = 0;
+
+    for (const auto& face : faces)
+    {
+        for (size_t i = 0; i < detections.size(); ++i)
+        {
+            if (!used[i] && overlap(face, detections[i]) >= MinimumOverlap)
+            {
+                used[i] = true;
+                ++matches;
+                break;
+            }
+        }
+    }
+
+    return matches;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " image.ppm [image.ppm ...]" << std::endl;
+        return 2;
+    }
+
+    std::vector<Image> images(argc - 1);
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!loadPpm(argv[i], &images[i - 1]))
+        {
+            std::cout << argv[i] << ": Unable to read image." << std::endl;
+            return 1;
+        }
+
+        loadFaces(&images[i - 1]);
+    }
+
+    for (const auto& factory : Factories)
+    {
+        std::string name;
+        double milliseconds = 0.0;
+        size_t faces = 0;
+        size_t detections = 0;
+        size_t matches = 0;
+
+        for (const auto& image : images)
+        {
+            const auto backend = factory(image.width, image.height);
+            RectList results;
+
+            name = backend->name();
+
+            double best = 1e9;
+
+            for (int i = 0; i < Iterations; ++i)
+            {
+                const auto start = std::chrono::steady_clock::now();
+                backend->process(std::span<const RgbPixel>(image.pixels), &results);
+                const auto end = std::chrono::steady_clock::now();
+
+                best = std::min(best, std::chrono::duration<double, std::milli>(end - start)
+                                          .count());
+            }
+
+            milliseconds += best;
+            faces += image.faces.size();
+            detections += results.size();
+            matches += countMatches(image.faces, results);
+        }
+
+        std::cout << name << ": " << milliseconds / images.size() << " ms per image, "
+                  << detections << " detections";
+
+        if (faces > 0)
+        {
+            std::cout << ", recall " << double(matches) / faces << ", precision "
+                      << (detections > 0 ? double(matches) / detections : 0.0);
+        }
+
+        std::cout << std::endl;
+    }
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,293 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 20;
+
+    constexpr int Width = 1920;
+    constexpr int Height = 1080;
+
+    struct Head
+    {
+        int step;
+        std::vector<float> sizes;
+    };
+
+    const Head Heads[] = {
+        { 8,  { 10, 16, 24 } },
+        { 16, { 32, 48 } },
+        { 32, { 64, 96 } },
+        { 64, { 128, 192, 256 } }
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Same layout as the prior boxes of the network
+static void createPriors(CDataBlob<float>& priors)
+{
+    CDataBlob<float> blobs[4];
+    CDataBlob<float> flat[4];
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const int featureWidth = (Width + Heads[i].step - 1) / Heads[i].step;
+        const int featureHeight = (Height + Heads[i].step - 1) / Heads[i].step;
+
+        auto sizes = Heads[i].sizes;
+        priorbox(featureWidth, featureHeight, Width, Height, Heads[i].step,
+                 static_cast<int>(sizes.size()), sizes.data(), blobs[i]);
+
+        blob2vector(blobs[i], flat[i]);
+    }
+
+    concat4(flat[0], flat[1], flat[2], flat[3], priors);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// A crowd of faces on a grid, every prior close to a face gets a high score.
+// spacing controls how crowded the scene is.
+static void createScores(CDataBlob<float>& priors, int spacing,
+                         CDataBlob<float>& loc, CDataBlob<float>& conf, CDataBlob<float>& iou)
+{
+    const int count = priors.channels / 4;
+
+    loc.create(1, 1, count * 14);
+    conf.create(1, 1, count * 2);
+    iou.create(1, 1, count);
+
+    std::mt19937 random(42);
+    std::uniform_real_distribution<float> noise(-0.5f, 0.5f);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const float* prior = priors.data + i*4;
+
+        const float x = (prior[0] + prior[2]) * 0.5f * Width;
+        const float y = (prior[1] + prior[3]) * 0.5f * Height;
+        const float size = (prior[2] - prior[0]) * Width;
+
+        const float dx = x - (std::floor(x / spacing) + 0.5f) * spacing;
+        const float dy = y - (std::floor(y / spacing) + 0.5f) * spacing;
+
+        const bool face = std::abs(dx) < 8.0f && std::abs(dy) < 8.0f
+                && size > spacing * 0.25f && size < spacing * 1.5f;
+
+        const float score = face ? 0.9f + 0.1f * noise(random) : 0.05f + 0.05f * noise(random);
+
+        conf.data[i*2] = 1.0f - score;
+        conf.data[i*2 + 1] = score;
+        iou.data[i] = face ? 0.8f + 0.2f * noise(random) : 0.5f;
+
+        for (int k = 0; k < 14; ++k)
+            loc.data[i*14 + k] = noise(random);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    // A face as written by detection_output(): score, box and five landmarks
+    using Face = std::array<float, 15>;
+
+    auto overlap(const Face& a, const Face& b) -> float
+    {
+        if (b[1] > a[3] || b[3] < a[1] || b[2] > a[4] || b[4] < a[2])
+            return 0.0f;
+
+        const float width = std::min(a[3], b[3]) - std::max(a[1], b[1]);
+        const float height = std::min(a[4], b[4]) - std::max(a[2], b[2]);
+
+        if (width <= 0 || height <= 0)
+            return 0.0f;
+
+        const float intersection = width * height;
+        const float sizeA = (a[3] - a[1]) * (a[4] - a[2]);
+        const float sizeB = (b[3] - b[1]) * (b[4] - b[2]);
+
+        return intersection / (sizeA + sizeB - intersection);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The unoptimized detection_output() of the original libfacedetection sources: every candidate
+// is decoded, all of them are sorted and compared with every kept face. Faces outside the size
+// range are dropped after the suppression but before keepTopK.
+static auto referenceOutput(CDataBlob<float>& priors, CDataBlob<float>& loc,
+                            CDataBlob<float>& conf, CDataBlob<float>& iou, float overlapThreshold,
+                            float confidenceThreshold, size_t topK, size_t keepTopK,
+                            int minimumSize = 0) -> std::vector<Face>
+{
+    const float variance[4] = { 0.1f, 0.1f, 0.2f, 0.2f };
+
+    std::vector<Face> candidates;
+
+    for (int i = 0; i < conf.channels / 2; ++i)
+    {
+        const float score = std::sqrt(conf.data[i*2 + 1] * std::clamp(iou.data[i], 0.f, 1.f));
+
+        if (score <= confidenceThreshold)
+            continue;
+
+        const float* prior = priors.data + i*4;
+        const float* offsets = loc.data + i*14;
+
+        const float priorWidth = prior[2] - prior[0];
+        const float priorHeight = prior[3] - prior[1];
+        const float priorX = (prior[0] + prior[2]) / 2;
+        const float priorY = (prior[1] + prior[3]) / 2;
+
+        const float x = variance[0] * offsets[0] * priorWidth + priorX;
+        const float y = variance[1] * offsets[1] * priorHeight + priorY;
+        const float width = std::exp(variance[2] * offsets[2]) * priorWidth;
+        const float height = std::exp(variance[3] * offsets[3]) * priorHeight;
+
+        Face face;
+        face[0] = score;
+        face[1] = std::max(0.f, x - width / 2.f);
+        face[2] = std::max(0.f, y - height / 2.f);
+        face[3] = std::min(1.f, x + width / 2.f);
+        face[4] = std::min(1.f, y + height / 2.f);
+
+        for (int k = 0; k < 5; ++k)
+        {
+            face[5 + k*2] = variance[0] * offsets[4 + k*2] * priorWidth + priorX;
+            face[6 + k*2] = variance[1] * offsets[5 + k*2] * priorHeight + priorY;
+        }
+
+        candidates.push_back(face);
+    }
+
+    std::stable_sort(candidates.begin(), candidates.end(), [](const Face& a, const Face& b) {
+        return a[0] > b[0];
+    });
+
+    candidates.resize(std::min(candidates.size(), topK));
+
+    std::vector<Face> kept;
+    std::vector<Face> faces;
+
+    for (const auto& candidate : candidates)
+    {
+        const bool keep = std::all_of(kept.begin(), kept.end(), [&](const Face& face) {
+            return overlap(candidate, face) <= overlapThreshold;
+        });
+
+        if (!keep)
+            continue;
+
+        kept.push_back(candidate);
+
+        const int width = int((candidate[3] - candidate[1]) * Width + 0.5f);
+        const int height = int((candidate[4] - candidate[2]) * Height + 0.5f);
+
+        if (std::max(width, height) >= minimumSize)
+            faces.push_back(candidate);
+    }
+
+    faces.resize(std::min(faces.size(), keepTopK));
+    return faces;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main() -> int
+{
+    CDataBlob<float> priors;
+    createPriors(priors);
+
+    std::cout << Width << "x" << Height << ", " << priors.channels / 4 << " priors" << std::endl;
+
+    bool success = true;
+
+    // The crowd of 20 px spacing fills keepTopK, a minimum size must not let the small faces
+    // displace the large ones
+    const struct
+    {
+        int spacing;
+        int minimumSize;
+    } scenes[] = { { 160, 0 }, { 80, 0 }, { 40, 0 }, { 20, 0 }, { 20, 24 } };
+
+    for (const auto& [spacing, minimumSize] : scenes)
+    {
+        CDataBlob<float> loc, conf, iou, faces;
+        createScores(priors, spacing, loc, conf, iou);
+
+        double best = 1e9;
+
+        for (int i = 0; i < Iterations; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            const FaceSizeRange range = { Width, Height, minimumSize, 0 };
+            detection_output(priors, loc, conf, iou, 0.3f, 0.5f, 5000, 1000, faces, &range);
+
+            const auto end = std::chrono::steady_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::milli>(end - start).count());
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto expected = referenceOutput(priors, loc, conf, iou, 0.3f, 0.5f, 5000, 1000,
+                                              minimumSize);
+        const auto end = std::chrono::steady_clock::now();
+        const double reference = std::chrono::duration<double, std::milli>(end - start).count();
+
+        bool equal = size_t(faces.cols) == expected.size();
+
+        // The compiler may contract the decoding into FMAs differently in both translation
+        // units, so the values are allowed to differ in the last bits.
+        for (size_t i = 0; equal && i < expected.size(); ++i)
+        {
+            const float* face = faces.ptr(0, int(i));
+
+            for (size_t k = 0; equal && k < expected[i].size(); ++k)
+                equal = std::abs(face[k] - expected[i][k]) <= 1e-6f;
+        }
+
+        std::cout << "Spacing " << spacing << " px, minimum size " << minimumSize << " px: "
+                  << faces.cols << " faces, " << best
+                  << " ms (reference " << reference << " ms)"
+                  << (equal ? "" : ", results differ from the reference") << std::endl;
+
+        success = success && equal;
+    }
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,187 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "../convert.h"
+#include "../dlibbackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 5;
+
+    struct Image
+    {
+        unsigned int width = 0;
+        unsigned int height = 0;
+        std::vector<RgbPixel> pixels;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->pixels.resize(size_t(image->width) * image->height);
+    file.read(reinterpret_cast<char*>(image->pixels.data()), image->pixels.size() * 3);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto detect(const Backend& backend, const Image& image, double* milliseconds) -> RectList
+{
+    RectList results;
+    *milliseconds = 1e9;
+
+    for (int i = 0; i < Iterations; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        backend.process(std::span<const RgbPixel>(image.pixels), &results);
+        const auto end = std::chrono::steady_clock::now();
+
+        const double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+        *milliseconds = std::min(*milliseconds, elapsed);
+    }
+
+    return results;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// What the serial backend did before it read the image through a view: copy the grayscale image
+// into an array2d and run the detector on that
+static auto detectCopy(const Image& image) -> RectList
+{
+    std::vector<GrayscalePixel> grayscale(image.pixels.size());
+    Convert::toGrayscale(std::span<const RgbPixel>(image.pixels), grayscale);
+
+    dlib::array2d<unsigned char> copy(long(image.height), long(image.width));
+    std::copy(grayscale.begin(), grayscale.end(), copy.begin());
+
+    std::vector<std::pair<double, dlib::rectangle>> detections;
+    dlib::get_frontal_face_detector()(copy, detections);
+
+    RectList results;
+
+    for (const auto& [confidence, rect] : detections)
+    {
+        if (confidence >= 0.1) // DlibBackend's minimum confidence
+            results.emplace_back(rect.left(), rect.top(), rect.width(), rect.height());
+    }
+
+    return results;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto equal(const RectList& a, const RectList& b) -> bool
+{
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Rect& x, const Rect& y) {
+        return x.x == y.x && x.y == y.y && x.width == y.width && x.height == y.height;
+    });
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    // The comparisons are only meaningful for images that contain faces
+    if (argc != 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <image.ppm>" << std::endl;
+        return 1;
+    }
+
+    Image image;
+
+    if (!loadPpm(argv[1], &image))
+    {
+        std::cout << argv[1] << ": Unable to read image." << std::endl;
+        return 1;
+    }
+
+    const auto copied = detectCopy(image);
+    bool success = !copied.empty();
+
+    std::cout << "Copying path: " << copied.size() << " faces"
+              << (success ? "" : ", the image needs to contain faces") << std::endl;
+
+    const unsigned int maximumSizes[] = { 0, 200 };
+
+    for (const auto maximumSize : maximumSizes)
+    {
+        DlibBackend serial(image.width, image.height);
+        DlibBackend parallel(image.width, image.height, DlibBackend::Scheduling::Parallel);
+
+        serial.setFaceSizeRange(0, maximumSize);
+        parallel.setFaceSizeRange(0, maximumSize);
+
+        double serialTime = 0.0;
+        double parallelTime = 0.0;
+
+        const auto expected = detect(serial, image, &serialTime);
+        const auto faces = detect(parallel, image, &parallelTime);
+
+        const bool same = equal(faces, expected);
+
+        // Without a maximum size, the serial path scans the same levels as the copying path
+        const bool sameAsCopy = maximumSize > 0 || equal(expected, copied);
+
+        std::cout << "Maximum size " << maximumSize << ": " << faces.size() << " faces, "
+                  << parallelTime << " ms (serial " << serialTime << " ms, "
+                  << serialTime / parallelTime << "x)"
+                  << (same ? "" : ", results differ from serial")
+                  << (sameAsCopy ? "" : ", serial results differ from copying path")
+                  << std::endl;
+
+        success = success && same && sameAsCopy;
+    }
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
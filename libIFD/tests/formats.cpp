@@ -0,0 +1,249 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 5;
+    constexpr int RowPadding = 12;
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        int step = 0;
+        std::vector<unsigned char> data;
+    };
+
+    struct Format
+    {
+        const char* name;
+        int format;
+        int channels;
+        bool rgb;
+    };
+
+    const Format Formats[] = {
+        { "BGR", FACEDETECT_FORMAT_BGR, 3, false },
+        { "RGB", FACEDETECT_FORMAT_RGB, 3, true },
+        { "BGRA", FACEDETECT_FORMAT_BGRA, 4, false },
+        { "RGBA", FACEDETECT_FORMAT_RGBA, 4, true },
+        { "GRAY", FACEDETECT_FORMAT_GRAY, 1, false }
+    };
+
+    struct Precision
+    {
+        const char* name;
+        int precision;
+    };
+
+    const Precision Precisions[] = {
+        { "FP32", FACEDETECT_PRECISION_FP32 },
+        { "INT8", FACEDETECT_PRECISION_INT8 },
+        { "FP16", FACEDETECT_PRECISION_FP16 }
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Loads the image as BGR without padding
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->step = image->width * 3;
+    image->data.resize(size_t(image->width) * image->height * 3);
+    file.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+
+    // PPM stores RGB, the detector expects BGR
+    for (size_t i = 0; i < image->data.size(); i += 3)
+        std::swap(image->data[i], image->data[i + 2]);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto createNoise(int width, int height) -> Image
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.step = width * 3;
+    image.data.resize(size_t(width) * height * 3);
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> noise(0, 255);
+
+    for (auto& value : image.data)
+        value = static_cast<unsigned char>(noise(random));
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The BGR image in another format, with padding at the end of the rows. The buffer ends with
+// the last pixel, so reading beyond it is caught by the address sanitizer.
+static auto convert(const Image& source, const Format& format) -> Image
+{
+    Image image;
+    image.width = source.width;
+    image.height = source.height;
+    image.step = source.width * format.channels + RowPadding;
+    image.data.resize(size_t(image.step) * (image.height - 1)
+                      + size_t(image.width) * format.channels);
+
+    for (int y = 0; y < image.height; ++y)
+    {
+        for (int x = 0; x < image.width; ++x)
+        {
+            const unsigned char* bgr = &source.data[size_t(y) * source.step + x * 3];
+            unsigned char* pixel = &image.data[size_t(y) * image.step + x * format.channels];
+
+            pixel[0] = format.rgb ? bgr[2] : bgr[0];
+
+            if (format.channels == 1)
+                continue;
+
+            pixel[1] = bgr[1];
+            pixel[2] = format.rgb ? bgr[0] : bgr[2];
+
+            if (format.channels == 4)
+                pixel[3] = static_cast<unsigned char>(x + y); // Must be ignored
+        }
+    }
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Grayscale formats are compared with a BGR image whose channels all hold the green channel
+static auto toGray(const Image& source) -> Image
+{
+    Image image = source;
+
+    for (size_t i = 0; i < image.data.size(); i += 3)
+        image.data[i] = image.data[i + 2] = image.data[i + 1];
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto detect(Image& image, int format, int precision, double* milliseconds)
+    -> std::vector<FaceDetection>
+{
+    std::vector<FaceDetection> faces(FACEDETECT_MAX_FACES);
+    int count = 0;
+
+    *milliseconds = 1e9;
+
+    for (int i = 0; i < Iterations; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        count = facedetect_cnn_faces(faces.data(), int(faces.size()), image.data.data(),
+                                     image.width, image.height, image.step, format, 0.0f,
+                                     precision, nullptr);
+
+        const auto end = std::chrono::steady_clock::now();
+        const double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+        *milliseconds = std::min(*milliseconds, elapsed);
+    }
+
+    faces.resize(std::max(count, 0));
+    return faces;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    Image source;
+
+    if (argc > 1 && !loadPpm(argv[1], &source))
+    {
+        std::cout << argv[1] << ": Unable to read image." << std::endl;
+        return 1;
+    }
+
+    if (source.data.empty())
+        source = createNoise(640, 480);
+
+    const Image sources[] = { source, toGray(source) };
+
+    bool success = true;
+
+    for (const auto& precision : Precisions)
+    {
+        for (const auto& format : Formats)
+        {
+            Image reference = sources[format.channels == 1 ? 1 : 0];
+            Image image = convert(reference, format);
+
+            double referenceTime = 0.0;
+            double time = 0.0;
+
+            const auto expected = detect(reference, FACEDETECT_FORMAT_BGR, precision.precision,
+                                         &referenceTime);
+            const auto faces = detect(image, format.format, precision.precision, &time);
+
+            const bool equal = faces.size() == expected.size()
+                    && std::memcmp(faces.data(), expected.data(),
+                                   faces.size() * sizeof(FaceDetection)) == 0;
+
+            std::cout << precision.name << ", " << format.name << ": " << faces.size()
+                      << " faces, " << time << " ms (BGR " << referenceTime << " ms)"
+                      << (equal ? "" : ", results differ from BGR") << std::endl;
+
+            success = success && equal;
+        }
+    }
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
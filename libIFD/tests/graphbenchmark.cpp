@@ -0,0 +1,171 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "../mediapipebackend.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Instances = 10;
+    constexpr int StreamedFrames = 30;
+
+    using Clock = std::chrono::steady_clock;
+
+    auto milliseconds(Clock::time_point start, Clock::time_point end) -> double
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // Alternate resolutions, as FaceViewer does when the scale changes
+    auto width(int instance) -> unsigned int { return instance % 2 ? 1280 : 640; }
+    auto height(int instance) -> unsigned int { return instance % 2 ? 720 : 480; }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The time until the first frame has been processed
+static auto startBackend(int instance, unsigned int inferenceThreads,
+                         std::vector<std::unique_ptr<Backend>>* backends) -> double
+{
+    const auto start = Clock::now();
+
+    auto backend = std::make_unique<MediaPipeBackend>(width(instance), height(instance));
+
+    if (inferenceThreads > 0)
+        backend->setThreadCount(0, inferenceThreads);
+
+    const std::vector<RgbPixel> image(width(instance) * height(instance));
+    RectList results;
+
+    backend->process(std::span<const RgbPixel>(image), &results);
+
+    const double elapsed = milliseconds(start, Clock::now());
+
+    // The previous backend is only destroyed after the next one was created
+    backends->push_back(std::move(backend));
+
+    return elapsed;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Destroys a streaming backend with frames in flight while another one processes frames on the
+// same graph. The destructor must return only once all streamed frames were delivered, and the
+// graph must keep running for the other backend.
+static auto destroyWhileStreaming() -> bool
+{
+    const std::vector<RgbPixel> image(width(1) * height(1));
+    const std::span<const RgbPixel> span(image);
+
+    MediaPipeBackend other(width(1), height(1));
+
+    std::atomic<bool> stop = false;
+    std::atomic<int> processed = 0;
+
+    std::thread thread([&] {
+        RectList results;
+
+        while (!stop)
+        {
+            other.process(span, &results);
+            ++processed;
+        }
+    });
+
+    std::atomic<int> delivered = 0;
+
+    auto streaming = std::make_unique<MediaPipeBackend>(width(1), height(1));
+    streaming->startStreaming([&](uint64_t, const RectList&) { ++delivered; }, 4);
+
+    for (int i = 0; i < StreamedFrames; ++i)
+        streaming->submit(span, i);
+
+    streaming.reset();
+
+    const int deliveredOnDestruction = delivered;
+    const int processedOnDestruction = processed;
+
+    const auto start = Clock::now();
+
+    while (processed < processedOnDestruction + 3 && milliseconds(start, Clock::now()) < 5000)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    stop = true;
+    thread.join();
+
+    const bool delivering = deliveredOnDestruction == StreamedFrames;
+    const bool running = processed >= processedOnDestruction + 3;
+
+    std::cout << "Destroyed while streaming: " << deliveredOnDestruction << " of "
+              << StreamedFrames << " frames delivered"
+              << (running ? "" : ", the other backend stopped") << std::endl;
+
+    return delivering && running;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main() -> int
+{
+    std::vector<std::unique_ptr<Backend>> backends;
+
+    const double first = startBackend(0, 0, &backends);
+    double shared = 0.0;
+
+    for (int i = 1; i < Instances; ++i)
+        shared += startBackend(i, 0, &backends);
+
+    shared /= Instances - 1;
+
+    // Settings without a running graph start a new one, as every backend did before
+    double started = 0.0;
+
+    for (int i = 0; i < Instances; ++i)
+        started += startBackend(i, i + 1, &backends);
+
+    started /= Instances;
+
+    std::cout << "MediaPipe, first backend: " << first << " ms" << std::endl;
+    std::cout << "MediaPipe, further backends: " << shared << " ms (starting a graph each time "
+              << started << " ms)" << std::endl;
+
+    backends.clear();
+
+    const bool success = destroyWhileStreaming();
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
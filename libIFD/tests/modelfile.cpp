@@ -0,0 +1,245 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr const char* ModelFile = "modelfile-test.bin";
+    constexpr const char* BrokenFile = "modelfile-broken.bin";
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> data;
+    };
+
+    const int Precisions[] = {
+        FACEDETECT_PRECISION_FP32,
+        FACEDETECT_PRECISION_INT8,
+        FACEDETECT_PRECISION_FP16
+    };
+
+    // The faces of all precisions, one after another, each list preceded by its size
+    using Results = std::vector<FaceDetection>;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Loads the image as BGR without padding
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->data.resize(size_t(image->width) * image->height * 3);
+    file.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+
+    // PPM stores RGB, the detector expects BGR
+    for (size_t i = 0; i < image->data.size(); i += 3)
+        std::swap(image->data[i], image->data[i + 2]);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto createNoise(int width, int height) -> Image
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.data.resize(size_t(width) * height * 3);
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> noise(0, 255);
+
+    for (auto& value : image.data)
+        value = static_cast<unsigned char>(noise(random));
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto detect(Image& image) -> Results
+{
+    Results results;
+
+    for (int precision : Precisions)
+    {
+        std::vector<FaceDetection> faces(FACEDETECT_MAX_FACES);
+        const int count = facedetect_cnn_faces(faces.data(), int(faces.size()), image.data.data(),
+                                               image.width, image.height, image.width * 3,
+                                               FACEDETECT_FORMAT_BGR, 0.0f, precision, nullptr);
+
+        FaceDetection header = {};
+        header.x = count;
+        results.push_back(header);
+        results.insert(results.end(), faces.begin(), faces.begin() + std::max(count, 0));
+    }
+
+    return results;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The results of the embedded weights, computed in a child process since the weights of a
+// process cannot be changed after the first detection
+static auto detectEmbedded(Image& image, Results* results) -> bool
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+
+    const pid_t child = fork();
+    if (child < 0)
+        return false;
+
+    if (child == 0)
+    {
+        close(fds[0]);
+        const Results childResults = detect(image);
+        const size_t bytes = childResults.size() * sizeof(FaceDetection);
+        const bool written = write(fds[1], childResults.data(), bytes) == ssize_t(bytes);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    FaceDetection face;
+    while (read(fds[0], &face, sizeof(face)) == sizeof(face))
+        results->push_back(face);
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Whether the model file is mapped into this process
+static auto isMapped(const char* fileName) -> bool
+{
+    std::ifstream maps("/proc/self/maps");
+    std::string line;
+
+    while (std::getline(maps, line))
+    {
+        if (line.find(fileName) != std::string::npos)
+            return true;
+    }
+
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto check(bool condition, const char* message) -> bool
+{
+    std::cout << message << (condition ? ": ok" : ": FAILED") << std::endl;
+    return condition;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    Image image;
+
+    if (argc > 1 && !loadPpm(argv[1], &image))
+    {
+        std::cout << argv[1] << ": Unable to read image." << std::endl;
+        return 1;
+    }
+
+    if (image.data.empty())
+        image = createNoise(640, 480);
+
+    bool success = check(facedetect_save_model(ModelFile) == 0, "Save the embedded weights");
+
+    // A model file of another version must be rejected without using any of it
+    std::vector<char> model;
+    {
+        std::ifstream file(ModelFile, std::ios::binary);
+        model.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    std::vector<char> broken = model;
+    broken[4] = 2;
+    std::ofstream(BrokenFile, std::ios::binary).write(broken.data(), std::streamsize(broken.size()));
+    success &= check(facedetect_load_model(BrokenFile) == -1, "Reject another version");
+
+    // The last blob ends beyond a truncated file
+    std::ofstream(BrokenFile, std::ios::binary).write(model.data(), std::streamsize(model.size() - 64));
+    success &= check(facedetect_load_model(BrokenFile) == -1, "Reject a truncated file");
+    std::remove(BrokenFile);
+
+    Results expected;
+    success &= check(detectEmbedded(image, &expected), "Detect with the embedded weights");
+
+    const auto start = std::chrono::steady_clock::now();
+    const int loaded = facedetect_load_model(ModelFile);
+    const auto end = std::chrono::steady_clock::now();
+
+    success &= check(loaded == 0, "Load the model file");
+    success &= check(isMapped(ModelFile), "The model file is mapped");
+    std::cout << "Loading took " << std::chrono::duration<double, std::milli>(end - start).count()
+              << " ms" << std::endl;
+
+    const Results results = detect(image);
+    success &= check(results.size() == expected.size()
+                     && std::memcmp(results.data(), expected.data(),
+                                    results.size() * sizeof(FaceDetection)) == 0,
+                     "Same results as the embedded weights in FP32, INT8 and FP16");
+
+    success &= check(facedetect_load_model(ModelFile) == -1, "Reject loading after detecting");
+    std::remove(ModelFile);
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,123 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "../dummybackend.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr unsigned int Width = 1280;
+    constexpr unsigned int Height = 720;
+    constexpr int Frames = 100;
+
+    // The synthetic backend spins exactly 5 ms and reads every pixel once, so process() takes the
+    // latency plus one pass over the image. Streaming runs the same work, anything it takes
+    // above process() is the pipeline's overhead.
+    constexpr const char* DefaultLoad = "latency=5,jitter=0,wait=spin,faces=1-5,read=1,format=gray";
+
+    using Clock = std::chrono::steady_clock;
+
+    auto milliseconds(Clock::time_point start, Clock::time_point end) -> double
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Milliseconds per frame with process() and with streaming, process() is the backend's own time
+template <typename T>
+static void measure(const std::string& format, const DummyBackend::Load& load)
+{
+    const double latency = load.latency;
+    DummyBackend backend(Width, Height, load);
+
+    const std::vector<T> image(Width * Height);
+    RectList results;
+
+    auto start = Clock::now();
+
+    for (int i = 0; i < Frames; ++i)
+        backend.process(std::span<const T>(image), &results);
+
+    const double processed = milliseconds(start, Clock::now()) / Frames;
+
+    size_t faces = 0;
+    backend.startStreaming([&](uint64_t, const RectList& results) {
+        faces += results.size();
+    }, 2);
+
+    start = Clock::now();
+
+    for (int i = 0; i < Frames; ++i)
+        backend.submit(std::span<const T>(image), i);
+
+    backend.stopStreaming();
+
+    const double streamed = milliseconds(start, Clock::now()) / Frames;
+
+    std::cout << format << ": process " << processed << " ms (" << processed - latency
+              << " ms above the latency), streaming " << streamed << " ms (overhead "
+              << streamed - processed << " ms), " << faces << " faces" << std::endl;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main() -> int
+{
+    // IFD_DUMMY_LOAD overrides the load so others can be profiled
+    const char* variable = std::getenv("IFD_DUMMY_LOAD");
+    const std::string settings = variable ? variable : DefaultLoad;
+
+    DummyBackend::Load load;
+
+    try {
+        load = DummyBackend::Load::parse(settings);
+    }
+    catch (const Error& error) {
+        std::cout << error.what() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Load: " << settings << std::endl;
+
+    measure<GrayscalePixel>("Grayscale", load);
+    measure<RgbPixel>("RGB", load);
+    measure<RgbaPixel>("RGBA", load);
+    measure<BgrPixel>("BGR", load);
+    measure<BgraPixel>("BGRA", load);
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,195 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr size_t BufferSize = 0x20000;
+    constexpr int RecordsStride = 142;
+    constexpr int MinimumConfidence = 50;
+    constexpr int Iterations = 10;
+    constexpr float MinimumOverlap = 0.5f;
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> data;
+    };
+
+    struct Face
+    {
+        int x, y, w, h;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->data.resize(size_t(image->width) * image->height * 3);
+    file.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+
+    // PPM stores RGB, the detector expects BGR
+    for (size_t i = 0; i < image->data.size(); i += 3)
+        std::swap(image->data[i], image->data[i + 2]);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto detect(Image& image, int precision, double* milliseconds) -> std::vector<Face>
+{
+    std::vector<unsigned char> buffer(BufferSize);
+    int* results = nullptr;
+
+    *milliseconds = 1e9;
+
+    for (int i = 0; i < Iterations; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        results = facedetect_cnn(buffer.data(), image.data.data(),
+                                 image.width, image.height, image.width * 3, precision);
+
+        const auto end = std::chrono::steady_clock::now();
+        *milliseconds = std::min(*milliseconds,
+                                 std::chrono::duration<double, std::milli>(end - start).count());
+    }
+
+    std::vector<Face> faces;
+
+    const auto records = reinterpret_cast<short*>(results + 1);
+
+    for (int i = 0; i < *results; ++i)
+    {
+        const short* record = records + i*RecordsStride;
+
+        if (record[0] > MinimumConfidence)
+            faces.push_back({ record[1], record[2], record[3], record[4] });
+    }
+
+    return faces;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto overlap(const Face& a, const Face& b) -> float
+{
+    const int w = std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x);
+    const int h = std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y);
+
+    if (w <= 0 || h <= 0)
+        return 0.0f;
+
+    const float intersection = float(w * h);
+    return intersection / (a.w * a.h + b.w * b.h - intersection);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto compare(const std::vector<Face>& reference, const std::vector<Face>& faces) -> bool
+{
+    bool success = true;
+
+    for (const auto& face : reference)
+    {
+        float best = 0.0f;
+
+        for (const auto& other : faces)
+            best = std::max(best, overlap(face, other));
+
+        if (best < MinimumOverlap)
+        {
+            std::cout << "  Face at " << face.x << "," << face.y << " not found" << std::endl;
+            success = false;
+        }
+    }
+
+    return success && reference.size() == faces.size();
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <image.ppm> [<image.ppm> ...]" << std::endl;
+        return 1;
+    }
+
+    bool success = true;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        Image image;
+
+        if (!loadPpm(argv[i], &image))
+        {
+            std::cout << argv[i] << ": Unable to read image." << std::endl;
+            return 1;
+        }
+
+        double fp32Time = 0.0;
+        double int8Time = 0.0;
+        double fp16Time = 0.0;
+
+        const auto reference = detect(image, FACEDETECT_PRECISION_FP32, &fp32Time);
+        const auto int8Faces = detect(image, FACEDETECT_PRECISION_INT8, &int8Time);
+        const auto fp16Faces = detect(image, FACEDETECT_PRECISION_FP16, &fp16Time);
+
+        std::cout << argv[i] << ": FP32 " << reference.size() << " faces, " << fp32Time << " ms"
+                  << " / INT8 " << int8Faces.size() << " faces, " << int8Time << " ms"
+                  << " / FP16 " << fp16Faces.size() << " faces, " << fp16Time << " ms" << std::endl;
+
+        if (!compare(reference, int8Faces) || !compare(reference, fp16Faces))
+            success = false;
+    }
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,134 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 10;
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> data;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->data.resize(size_t(image->width) * image->height * 3);
+    file.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+
+    // PPM stores RGB, the detector expects BGR
+    for (size_t i = 0; i < image->data.size(); i += 3)
+        std::swap(image->data[i], image->data[i + 2]);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto parsePrecision(const std::string& name, int* precision) -> bool
+{
+    if (name == "fp32")
+        *precision = FACEDETECT_PRECISION_FP32;
+    else if (name == "int8")
+        *precision = FACEDETECT_PRECISION_INT8;
+    else if (name == "fp16")
+        *precision = FACEDETECT_PRECISION_FP16;
+    else
+        return false;
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    int precision = FACEDETECT_PRECISION_FP32;
+    int format = FACEDETECT_PROFILE_TABLE;
+
+    if (argc < 2 || (argc > 2 && !parsePrecision(argv[2], &precision))
+            || (argc > 3 && std::string(argv[3]) != "json"))
+    {
+        std::cout << "Usage: " << argv[0] << " <image.ppm> [fp32|int8|fp16] [json]" << std::endl;
+        return 1;
+    }
+
+    if (argc > 3)
+        format = FACEDETECT_PROFILE_JSON;
+
+    Image image;
+
+    if (!loadPpm(argv[1], &image))
+    {
+        std::cout << argv[1] << ": Unable to read image." << std::endl;
+        return 1;
+    }
+
+    FaceDetectWorkspace* workspace = facedetect_create_workspace();
+    std::vector<FaceDetection> faces(FACEDETECT_MAX_FACES);
+
+    // The first call initializes the network and is not part of the profile
+    facedetect_cnn_faces(faces.data(), FACEDETECT_MAX_FACES, image.data.data(), image.width,
+                         image.height, image.width * 3, FACEDETECT_FORMAT_BGR, 0.0f, precision,
+                         workspace);
+
+    facedetect_set_profiling(workspace, 1);
+
+    for (int i = 0; i < Iterations; ++i)
+        facedetect_cnn_faces(faces.data(), FACEDETECT_MAX_FACES, image.data.data(), image.width,
+                             image.height, image.width * 3, FACEDETECT_FORMAT_BGR, 0.0f, precision,
+                         workspace);
+
+    std::string report(facedetect_profile_report(workspace, format, nullptr, 0), '\0');
+    facedetect_profile_report(workspace, format, report.data(), int(report.size()) + 1);
+
+    facedetect_release_workspace(workspace);
+
+    std::cout << report;
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
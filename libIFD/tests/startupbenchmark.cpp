@@ -0,0 +1,113 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "../opencvbackend.h"
+#include "opencvmodel.h" // auto-generated
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Instances = 20;
+
+    using Clock = std::chrono::steady_clock;
+
+    auto milliseconds(Clock::time_point start, Clock::time_point end) -> double
+    {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// What every backend did before the model was shared
+static auto parseModel() -> double
+{
+    const auto start = Clock::now();
+
+    cv::FileStorage storage(opencvmodel, cv::FileStorage::READ | cv::FileStorage::MEMORY);
+    cv::CascadeClassifier classifier;
+
+    if (!classifier.read(storage.getFirstTopLevelNode()))
+        throw Error("Unable to load model.");
+
+    return milliseconds(start, Clock::now());
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// The first backend parses the shared model, the later ones only read their classifier from it
+static auto createBackends(double* first) -> double
+{
+    std::vector<std::unique_ptr<Backend>> backends;
+    double total = 0.0;
+
+    for (int i = 0; i < Instances; ++i)
+    {
+        // Alternate resolutions, as a pool recreating detectors would
+        const unsigned int width = i % 2 ? 1280 : 640;
+        const unsigned int height = i % 2 ? 720 : 480;
+
+        const auto start = Clock::now();
+        backends.push_back(OpenCVBackend::make(width, height));
+        const double elapsed = milliseconds(start, Clock::now());
+
+        if (i == 0)
+            *first = elapsed;
+        else
+            total += elapsed;
+    }
+
+    return total / (Instances - 1);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main() -> int
+{
+    double first = 0.0;
+    const double shared = createBackends(&first);
+
+    double parsed = 0.0;
+
+    for (int i = 0; i < Instances; ++i)
+        parsed += parseModel();
+
+    parsed /= Instances;
+
+    std::cout << "OpenCV, first backend: " << first << " ms" << std::endl;
+    std::cout << "OpenCV, further backends: " << shared << " ms (parsing each time "
+              << parsed << " ms)" << std::endl;
+
+    return 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
@@ -0,0 +1,237 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include <facedetectcnn.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr int Iterations = 6;
+    constexpr int Width = 1280;
+    constexpr int Height = 720;
+    constexpr int TileSize = 32;
+    constexpr double ChangedFractions[] = { 0.0, 0.01, 0.05, 0.1, 0.25, 0.5, 1.0 };
+
+    struct Image
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> data;
+    };
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto loadPpm(const std::string& fileName, Image* image) -> bool
+{
+    std::ifstream file(fileName, std::ios::binary);
+
+    std::string magic;
+    int maxValue = 0;
+
+    file >> magic >> image->width >> image->height >> maxValue;
+    file.get();
+
+    if (!file || magic != "P6" || maxValue != 255)
+        return false;
+
+    image->data.resize(size_t(image->width) * image->height * 3);
+    file.read(reinterpret_cast<char*>(image->data.data()), image->data.size());
+
+    // PPM stores RGB, the detector expects BGR
+    for (size_t i = 0; i < image->data.size(); i += 3)
+        std::swap(image->data[i], image->data[i + 2]);
+
+    return bool(file);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Nearest neighbor scaling
+static auto scale(const Image& source, int width, int height) -> Image
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.data.resize(size_t(width) * height * 3);
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            const int sx = x * source.width / width;
+            const int sy = y * source.height / height;
+
+            std::memcpy(&image.data[(size_t(y) * width + x) * 3],
+                        &source.data[(size_t(sy) * source.width + sx) * 3], 3);
+        }
+    }
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto createNoise(int width, int height) -> Image
+{
+    Image image;
+    image.width = width;
+    image.height = height;
+    image.data.resize(size_t(width) * height * 3);
+
+    std::mt19937 random(42);
+    std::uniform_int_distribution<int> noise(0, 255);
+
+    for (auto& value : image.data)
+        value = static_cast<unsigned char>(noise(random));
+
+    return image;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Changes a block of tiles in the center of the image like an object moving through the scene,
+// returns the fraction of the tiles that have changed
+static auto changeTiles(Image* image, double fraction) -> double
+{
+    const int tileCols = (image->width + TileSize - 1) / TileSize;
+    const int tileRows = (image->height + TileSize - 1) / TileSize;
+    const double tiles = fraction * tileCols * tileRows;
+
+    if (tiles <= 0.0)
+        return 0.0;
+
+    const double aspect = double(tileCols) / tileRows;
+    const int cols = std::clamp(int(std::ceil(std::sqrt(tiles * aspect))), 1, tileCols);
+    const int rows = std::clamp(int(std::ceil(tiles / cols)), 1, tileRows);
+
+    const int x0 = (tileCols - cols) / 2 * TileSize;
+    const int y0 = (tileRows - rows) / 2 * TileSize;
+    const int x1 = std::min(x0 + cols * TileSize, image->width);
+    const int y1 = std::min(y0 + rows * TileSize, image->height);
+
+    for (int y = y0; y < y1; ++y)
+        for (int x = x0; x < x1; ++x)
+            image->data[(size_t(y) * image->width + x) * 3] ^= 0x10;
+
+    return double(cols) * rows / (tileCols * tileRows);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto detect(Image& image, FaceDetectWorkspace* workspace, double* milliseconds)
+    -> std::vector<FaceDetection>
+{
+    std::vector<FaceDetection> faces(FACEDETECT_MAX_FACES);
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const int count = facedetect_cnn_faces(faces.data(), int(faces.size()), image.data.data(),
+                                           image.width, image.height, image.width * 3,
+                                           FACEDETECT_FORMAT_BGR, 0.0f, FACEDETECT_PRECISION_FP32,
+                                           workspace);
+
+    const auto end = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double, std::milli>(end - start).count();
+    *milliseconds = std::min(*milliseconds, elapsed);
+
+    faces.resize(std::max(count, 0));
+    return faces;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+static auto equal(const std::vector<FaceDetection>& a, const std::vector<FaceDetection>& b) -> bool
+{
+    return a.size() == b.size()
+            && std::memcmp(a.data(), b.data(), a.size() * sizeof(FaceDetection)) == 0;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto main(int argc, char* argv[]) -> int
+{
+    Image source;
+
+    if (argc > 1 && !loadPpm(argv[1], &source))
+    {
+        std::cout << argv[1] << ": Unable to read image." << std::endl;
+        return 1;
+    }
+
+    const Image first = source.data.empty() ? createNoise(Width, Height)
+                                            : scale(source, Width, Height);
+
+    bool success = true;
+
+    FaceDetectWorkspace* workspace = facedetect_create_workspace();
+    FaceDetectWorkspace* videoWorkspace = facedetect_create_workspace();
+    facedetect_set_video_mode(videoWorkspace, 1);
+
+    for (double fraction : ChangedFractions)
+    {
+        // The frames alternate, so every frame differs from the previous one by the same tiles
+        Image frames[2] = { first, first };
+        const double changed = changeTiles(&frames[1], fraction);
+
+        double fullTime = 1e9;
+        double videoTime = 1e9;
+
+        for (int i = 0; i < 2 * Iterations; ++i)
+        {
+            Image& frame = frames[i % 2];
+
+            const auto reference = detect(frame, workspace, &fullTime);
+            const auto faces = detect(frame, videoWorkspace, &videoTime);
+
+            if (!equal(reference, faces))
+            {
+                std::cout << "  Frame " << i << ": video mode results differ from full inference"
+                          << std::endl;
+                success = false;
+            }
+        }
+
+        std::cout << Width << "x" << Height << ", " << 100.0 * changed << "% of the tiles changed: "
+                  << fullTime << " ms full, " << videoTime << " ms video mode ("
+                  << fullTime / videoTime << "x)" << std::endl;
+    }
+
+    facedetect_release_workspace(videoWorkspace);
+    facedetect_release_workspace(workspace);
+
+    std::cout << (success ? "All tests passed." : "Tests failed.") << std::endl;
+    return success ? 0 : 1;
+}
+
+// ---------------------------------------------------------------------------------------------- //
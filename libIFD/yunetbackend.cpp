@@ -0,0 +1,211 @@
+// ============================================================================================== //
+//                                                                                                //
+//  This file is part of the ISF Face Detector library.                                           //
+//                                                                                                //
+//  Author:                                                                                       //
+//  Marcel Hasler <mahasler@gmail.com>                                                            //
+//                                                                                                //
+//  Copyright (c) 2021 - 2023                                                                     //
+//  Bonn-Rhein-Sieg University of Applied Sciences                                                //
+//                                                                                                //
+//  This library is free software: you can redistribute it and/or modify it under the terms of    //
+//  the GNU Lesser General Public License as published by the Free Software Foundation, either    //
+//  version 3 of the License, or (at your option) any later version.                              //
+//                                                                                                //
+//  This library is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;     //
+//  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.     //
+//  See the GNU Lesser General Public License for more details.                                   //
+//                                                                                                //
+//  You should have received a copy of the GNU Lesser General Public License along with this      //
+//  library. If not, see <https://www.gnu.org/licenses/>.                                         //
+//                                                                                                //
+// ============================================================================================== //
+
+#include "convert.h"
+#include "yunetbackend.h"
+#include "yunetmodel.h" // auto-generated
+
+#include <iterator>
+#include <mutex>
+
+// ---------------------------------------------------------------------------------------------- //
+
+using namespace ifd;
+
+// ---------------------------------------------------------------------------------------------- //
+
+namespace {
+    constexpr float ScoreThreshold = 0.9f;
+    constexpr float NmsThreshold = 0.3f;
+    constexpr int TopK = 5000;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Detectors of destroyed backends are kept while other backends exist, so a new backend for
+// another resolution only changes the input size of a loaded network instead of reading the
+// model again. The pool and its detectors are released together with the last backend.
+class YuNetBackend::DetectorPool
+{
+public:
+    static auto get() -> std::shared_ptr<DetectorPool>
+    {
+        static std::mutex poolMutex;
+        static std::weak_ptr<DetectorPool> currentPool;
+
+        std::lock_guard lock(poolMutex);
+        std::shared_ptr<DetectorPool> pool = currentPool.lock();
+
+        if (!pool)
+        {
+            pool = std::make_shared<DetectorPool>();
+            currentPool = pool;
+        }
+
+        return pool;
+    }
+
+    auto take(const cv::Size& size) -> cv::Ptr<cv::FaceDetectorYN>
+    {
+        std::lock_guard lock(m_mutex);
+
+        if (!m_idleDetectors.empty())
+        {
+            cv::Ptr<cv::FaceDetectorYN> detector = m_idleDetectors.back();
+            m_idleDetectors.pop_back();
+
+            detector->setInputSize(size);
+            return detector;
+        }
+
+        const std::vector<uchar> model(std::begin(yunetmodel), std::end(yunetmodel));
+        return cv::FaceDetectorYN::create("onnx", model, {}, size, ScoreThreshold, NmsThreshold,
+                                          TopK);
+    }
+
+    void release(const cv::Ptr<cv::FaceDetectorYN>& detector)
+    {
+        std::lock_guard lock(m_mutex);
+        m_idleDetectors.push_back(detector);
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<cv::Ptr<cv::FaceDetectorYN>> m_idleDetectors;
+};
+
+// ---------------------------------------------------------------------------------------------- //
+
+YuNetBackend::YuNetBackend(unsigned int width, unsigned int height)
+    : Backend(width, height),
+      m_pool(DetectorPool::get()),
+      m_detector(m_pool->take(cv::Size(width, height))),
+      m_bgrImage(width * height)
+{
+    if (!m_detector)
+        throw Error("Unable to load model.");
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+YuNetBackend::~YuNetBackend()
+{
+    m_pool->release(m_detector);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto YuNetBackend::name() const -> std::string
+{
+    return Name;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto YuNetBackend::preferredImageFormat() const -> ImageFormat
+{
+    return ImageFormat::Bgr;
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void YuNetBackend::process(std::span<const GrayscalePixel> image, RectList* results) const
+{
+    Convert::toBgr(image, m_bgrImage);
+    process(m_bgrImage, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void YuNetBackend::process(std::span<const RgbPixel> image, RectList* results) const
+{
+    Convert::toBgr(image, m_bgrImage);
+    process(m_bgrImage, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void YuNetBackend::process(std::span<const RgbaPixel> image, RectList* results) const
+{
+    Convert::toBgr(image, m_bgrImage);
+    process(m_bgrImage, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void YuNetBackend::process(std::span<const BgrPixel> image, RectList* results) const
+{
+    auto data = const_cast<BgrPixel*>(image.data());
+    const cv::Mat cvImage(height(), width(), CV_8UC3, data);
+
+    m_detector->detect(cvImage, m_faces);
+    updateResults(results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+void YuNetBackend::process(std::span<const BgraPixel> image, RectList* results) const
+{
+    Convert::toBgr(image, m_bgrImage);
+    process(m_bgrImage, results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+// Each row holds the box, five landmarks and the score, only the box is reported
+void YuNetBackend::updateResults(RectList* results) const
+{
+    results->clear();
+
+    for (int i = 0; i < m_faces.rows; ++i)
+    {
+        const float* face = m_faces.ptr<float>(i);
+
+        // Boxes may extend beyond the image
+        const float left = std::max(face[0], 0.0f);
+        const float top = std::max(face[1], 0.0f);
+        const float right = std::min(face[0] + face[2], float(width()));
+        const float bottom = std::min(face[1] + face[3], float(height()));
+
+        if (right <= left || bottom <= top)
+            continue;
+
+        const auto x = static_cast<unsigned int>(left);
+        const auto y = static_cast<unsigned int>(top);
+        const auto w = static_cast<unsigned int>(right - left);
+        const auto h = static_cast<unsigned int>(bottom - top);
+
+        results->emplace_back(x, y, w, h);
+    }
+
+    filterFaceSizes(results);
+}
+
+// ---------------------------------------------------------------------------------------------- //
+
+auto YuNetBackend::make(unsigned int width, unsigned int height) -> std::unique_ptr<Backend>
+{
+    return std::make_unique<YuNetBackend>(width, height);
+}
+
+// ---------------------------------------------------------------------------------------------- //